@@ -4,7 +4,7 @@ if [ "$(uname)" = "Linux" ]; then
     echo "Detected Linux"
     export CC=gcc
     export CXX=g++
-    g++ -o build BUILD.cpp  
+    g++ -pthread -o build BUILD.cpp  
 fi
 
 if [ "$(uname)" = "Darwin" ]; then 
@@ -10,20 +10,53 @@ Full License can be found at THE END of this file
 #include <vector> // std::vector
 #include <iostream> // std::cerr, std::cout, std::endl
 #include <string> // std::string
-#include <sstream> // std::istringstream
+#include <sstream> // std::istringstream, std::ostringstream
+#include <iomanip> // std::hex, std::setw, std::setfill
 #include <filesystem> // std::filesystem::create_directory, std::filesystem::create_directories, std::filesystem::path,
                       // std::filesystem::remove_all
+#include <memory> // std::unique_ptr, std::make_unique
+#include <thread> // std::thread
+#include <mutex> // std::mutex, std::lock_guard
+#include <atomic> // std::atomic
+#include <condition_variable> // std::condition_variable
+#include <deque> // std::deque
+#include <chrono> // std::chrono::steady_clock
+#include <fstream> // std::ifstream, std::ofstream
+#include <unordered_map> // std::unordered_map
+#include <unordered_set> // std::unordered_set
+#include <map> // std::map
+#include <set> // std::set, std::multiset
+#include <algorithm> // std::sort
+#include <iterator> // std::make_move_iterator
 
 // C Headers
-#include <cstdlib> // exit, getenv, size_t, system
-#include <cstring> // strcmp
-#include <cctype> // isprint
+#include <cstdlib> // exit, getenv, size_t, atoi, strtoull
+#include <cstdio> // popen, pclose, fgets, snprintf
+#include <cerrno> // errno, EINTR
+#include <cstring> // strcmp, memcpy
+#include <cctype> // isprint, isspace
+#include <cstdint> // uint32_t, uint64_t, int64_t, INT64_MIN, SIZE_MAX
 
 // Platform Headers
 #ifdef _WIN32 
 #include <windows.h> // SetCurrentDirectory
+#define popen _popen
+#define pclose _pclose
 #else 
-#include <unistd.h> // chdir
+#include <unistd.h> // chdir, pipe, read, close, execv
+#include <fcntl.h> // fcntl, FD_CLOEXEC, open, openat, AT_FDCWD
+#include <spawn.h> // posix_spawnp, posix_spawn_file_actions_t
+#include <sys/wait.h> // WIFEXITED, WEXITSTATUS
+#include <sys/resource.h> // wait4, struct rusage
+#include <sys/stat.h> // statx, fstatat, struct stat
+#include <sys/socket.h> // socket, bind, listen, accept, accept4, connect, send, recv
+#include <sys/un.h> // struct sockaddr_un
+#include <netdb.h> // getaddrinfo, freeaddrinfo
+#include <poll.h> // poll
+#ifdef __linux__
+#include <sys/inotify.h> // inotify_init1, inotify_add_watch, struct inotify_event
+#endif
+extern char **environ; // Passed on to every spawned command
 #endif
 
 /* These are the macros to make using ObjBuild a lot cleaner
@@ -34,7 +67,7 @@ Full License can be found at THE END of this file
 
 #define B_MakeBuild \
     int main(int argc, char* argv[]) { \
-    std::unique_ptr<ObjBuild> ObjB = std::make_unique<ObjBuild>(argc, argv);
+    std::unique_ptr<ObjBuild> ObjB = std::make_unique<ObjBuild>(argc, argv, __FILE__);
 
 #define B_DoBuild ObjB->DoBuild(); }
 #define B_AddDepLib ObjB->AddDepLib
@@ -46,118 +79,2938 @@ Full License can be found at THE END of this file
 #define B_ProjectType ObjB->ProjectType
 #define B_AddLinkOpt ObjB->AddLinkOpt
 #define B_AddLibPath ObjB->AddLibPath 
+#define B_SetCacheDir ObjB->SetCacheDir
+#define B_AddPrecompiledHeader ObjB->AddPrecompiledHeader
+#define B_SetUnityBuild ObjB->SetUnityBuild
+#define B_UnityExclude ObjB->UnityExclude
+#define B_TargetLinks ObjB->TargetLinks
+#define B_AddSources ObjB->AddSources
+#define B_EnableLTO ObjB->EnableLTO
+#define B_SetPgoTraining ObjB->SetPgoTraining
+#define B_AddProfile ObjB->AddProfile
+#define B_SetCacheSize ObjB->SetCacheSize
+#define B_SetMemoryBudget ObjB->SetMemoryBudget
+#define B_UseLinker ObjB->UseLinker
+#define B_SetDebugInfo ObjB->SetDebugInfo
+#define B_SetArchiveMode ObjB->SetArchiveMode
+#define B_AddWorker ObjB->AddWorker
+#define B_AddToolchain ObjB->AddToolchain
+#define B_BuildMatrix ObjB->BuildMatrix
 #define B_Message(Message) std::cout << Message << std::endl  
 #define B_Error(Message) \
         std::cerr << Message << std::endl; \
         exit(1);
 
-#define B_CC ObjB->CC; // C Compiler
-#define B_CXX ObjB->CXX; // C++ Compiler
-#define B_Apple ObjB->Apple // Platform Apple
-#define B_Windows ObjB->Windows// Platform Windows
-#define B_Linux ObjB->Linux// Platform Linux
-#define B_IsMSVC ObjB->IsMSVC
+#define B_CC ObjB->CC; // C Compiler
+#define B_CXX ObjB->CXX; // C++ Compiler
+#define B_Apple ObjB->Apple // Platform Apple
+#define B_Windows ObjB->Windows// Platform Windows
+#define B_Linux ObjB->Linux// Platform Linux
+#define B_IsMSVC ObjB->IsMSVC
+#define B_Profile ObjB->Profile // Profile from `--profile=`, empty for none
+
+// Start of actual code
+
+class ObjBuild {
+typedef struct Target { // Target type, does NOT contain compilation info
+    std::string name;
+    std::vector<std::string> files;
+} Target;
+enum JobKind { CompileJob, LinkJob, ArchiveJob, PackageJob }; // What a job's command does, for traces and scheduling
+typedef struct Job { // A single command to run in the job pool
+    std::string banner; // Printed together with the command's output, e.g. "COMPILE: ../src/File1.c"
+    std::vector<std::string> argv; // Program and arguments, run directly without a shell
+    std::string output; // File the command produces, relative to Obuild
+    std::vector<std::string> inputs; // Files the output is built from, the job is skipped when none are newer
+    bool deps = false; // Compile job whose header dependencies are kept in the dep store
+    std::vector<std::string> preargv{}; // Preprocess command keying the compiler cache, empty when the job isn't cacheable
+    JobKind kind = CompileJob;
+    bool remote = false; // Compile a worker may run from its preprocessed source, see RemoteCompile
+} Job;
+typedef struct UnityConfig { // How a target's sources are merged into unity files, both 0 means no unity build
+    size_t files = 0; // Max sources per unity file
+    size_t bytes = 0; // Max total source size per unity file
+} UnityConfig;
+typedef struct SourceGlob { // Sources of a target given as a pattern, see AddSources
+    std::string target;
+    std::string pattern; // e.g. "src/**/*.c"
+    std::vector<std::string> exclude; // Patterns taken back out, e.g. "src/legacy/**"
+} SourceGlob;
+typedef struct BuildProfile { // A named configuration chosen with `--profile=`, see AddProfile
+    std::vector<std::string> compile; // Added to every compile
+    std::vector<std::string> link; // Added to every link, as compiler driver flags
+} BuildProfile;
+typedef struct Toolchain { // Compilers a build matrix builds with, see AddToolchain
+    std::string cc;
+    std::string cxx;
+} Toolchain;
+typedef struct MatrixConfig { // One toolchain and profile of a build matrix, see BuildMatrix
+    std::string toolchain;
+    std::string profile; // Empty for only BUILD.cpp's own flags
+    std::string tree; // "<toolchain>/<profile>/" in Obuild
+    size_t first = 0; // Its jobs in the matrix build's job list
+    size_t count = 0;
+} MatrixConfig;
+typedef struct DirListing { // One directory of the directory index
+    int64_t mtime = 0; // The directory's own modification time when it was listed
+    std::vector<std::string> files; // Sorted names
+    std::vector<std::string> dirs;
+} DirListing;
+typedef struct TraceEvent { // One finished command, for --trace
+    std::string name; // The job's banner
+    JobKind kind;
+    double start; // Seconds since the build started
+    double wall; // Seconds it took
+    double usertime; // CPU seconds, see CmdResult
+    double systime;
+    long maxrss; // KiB
+    size_t worker; // Which job pool thread ran it
+} TraceEvent;
+typedef struct CmdResult { // What a finished command left behind
+    int status = -1; // Exit code, -1 if it couldn't be started or died from a signal
+    std::string output; // Everything it wrote to stdout and stderr
+    double usertime = 0; // CPU seconds spent in the command itself
+    double systime = 0; // CPU seconds spent in the kernel for it
+    long maxrss = 0; // Peak resident set size, in KiB
+} CmdResult;
+
+private:
+    bool HasHead = false;
+    bool IsDone = false;
+    bool IsCXX = false;
+    bool IsC = false;
+
+    std::mutex OutputLock; // Held while a finished job prints, so parallel jobs never interleave
+    std::mutex SpawnLock; // Held from creating a job's pipe until its child is spawned
+    std::atomic<size_t> FailedJobs{0}; // Commands that exited non-zero this build
+
+    std::chrono::steady_clock::time_point BuildStart; // Trace times are relative to this
+    std::mutex TraceLock;
+    std::vector<TraceEvent> Trace; // Every command run this build
+
+    /* The dep store, kept in Obuild/.obuild_deps
+            Every path is stored once in DepPaths, and each object maps to the ids of the files it was built from
+            (its source and every header the compiler reported), so touching a header only rebuilds its includers
+    */
+    std::mutex DepLock;
+    std::vector<std::string> DepPaths;
+    std::unordered_map<std::string, uint32_t> DepPathIds;
+    std::unordered_map<std::string, std::vector<uint32_t>> DepRecords;
+    std::vector<uint32_t> DepStatIds; // DepPaths id -> file table id, UINT32_MAX until InputIds first needs it
+    const char* DepStoreName = ".obuild_deps";
+    const uint32_t DepStoreVersion = 1;
+
+    typedef struct StoreReader { // A store file read into memory in one go, see ReadStore
+        std::string data;
+        size_t pos = 0;
+        bool ok = true; // False once a read ran past the end
+    } StoreReader;
+
+    typedef struct LogEntry { // What an output was last built with
+        uint64_t cmdhash = 0; // Hash of the exact command line, 0 after a failure so it's always rebuilt
+        int64_t inputstamp = 0; // Newest input modification time when it was built
+        uint64_t maxrss = 0; // Peak memory its command took last time it ran, KiB, what the scheduler budgets for it
+        uint64_t duration = 0; // Wall time its command took last time it ran, microseconds, what the critical path is measured in
+    } LogEntry;
+
+    /* The build log, kept in Obuild/.obuild_log
+            Changing flags, compilers or include paths changes the command hash, so exactly the outputs
+            built with that command are redone, and an input whose time moved (even backwards) is caught too
+    */
+    std::mutex LogLock;
+    std::unordered_map<std::string, LogEntry> BuildLog;
+    const char* BuildLogName = ".obuild_log";
+    const uint32_t BuildLogVersion = 4; // 2: stamps are nanoseconds since 1970, as the file table reads them, 3: peak memory, 4: durations
+
+    typedef struct FileState { // One entry of the file table
+        int64_t mtime = 0; // Modification time, nanoseconds since 1970
+        uint8_t state = 0; // 0 not stat'ed yet, 1 exists, 2 missing
+    } FileState;
+
+    /* The file table, every path the build looks at is stat'ed once
+            ScanFiles fills it in one batched pass before any job runs, and a job's output is stat'ed again
+            after the job wrote it, everything else only reads it
+    */
+    std::mutex StatLock;
+    std::unordered_map<std::string, uint32_t> StatIds; // Path -> index into StatTable
+    std::vector<FileState> StatTable;
+    std::vector<const std::string*> StatPaths; // Index -> path, the keys of StatIds (which never move)
+    std::unordered_set<std::string> MadeDirs; // Object directories already created this run
+
+    bool ShowStats = false; // `--stats`
+    std::string CmdMem; // `--mem=` from the command line, wins over OBJBUILD_MEM and SetMemoryBudget
+    bool Watch = false; // `--watch`
+    char **DriverArgv = nullptr; // The command line and BUILD.cpp, kept for RebuildDriver when --watch sees BUILD.cpp change
+    const char* DriverFile = nullptr;
+    std::chrono::steady_clock::time_point ProcessStart = std::chrono::steady_clock::now();
+    std::atomic<size_t> StatCalls{0}; // stat syscalls made for the file table
+    std::atomic<size_t> DirOpens{0}; // Directories opened to stat relative to
+    std::atomic<size_t> UpToDateChecks{0};
+    double ScanTime = 0; // Seconds spent in ScanFiles
+
+    /* What RunJobs worked out about the jobs it's running, by job index
+            Which ones have to run, how long each is expected to take and the longest chain of
+            expected time from each one to the end of the build, which is what the pool runs first
+    */
+    std::vector<char> JobDirty;
+    std::vector<char> JobFailed; // It failed, or was skipped because something it needs failed
+    std::vector<double> JobCpu; // CPU seconds it took, 0 when it didn't run here (cached, remote, up to date)
+    std::vector<double> JobEnd; // When it finished, seconds since the build started
+    std::vector<double> JobEstimate; // Seconds, see JobDurations
+    std::vector<double> JobPath; // Seconds, itself plus the longest of what waits on it
+    std::mutex ProgressLock;
+    std::multiset<double> PathsLeft; // JobPath of every job that still has to start
+    double WorkLeft = 0; // JobEstimate of every job that still has to start, summed
+    std::unordered_map<size_t, double> RunningSince; // Job running now -> SinceStart when it started
+    size_t ProgressDone = 0, ProgressTotal = 0;
+
+    /* The compiler cache, off unless a directory is set
+            Each compile is keyed on the compiler binary, the full command and the preprocessed source,
+            entries live in <CacheDir>/<xx>/<key>.o with the compiler's output next to them in <key>.txt
+            and an entry's modification time is its last use, which is what eviction goes by
+    */
+    std::mutex CacheLock;
+    std::unordered_map<std::string, std::string> CompilerIds; // Compiler -> identity, found once per build
+    std::unordered_map<std::string, std::string> JobCacheKeys; // Object -> cache entry its compile is stored under
+    std::atomic<size_t> CacheHits{0};
+    std::atomic<size_t> CacheMisses{0};
+    std::atomic<size_t> CacheStores{0};
+
+    std::map<std::string, BuildProfile> Profiles; // Name -> flags, Debug / Release / RelWithDebInfo plus AddProfile's
+    std::map<std::string, Toolchain> Toolchains; // Name -> compilers, from AddToolchain
+    std::vector<MatrixConfig> Matrix; // Every configuration BuildMatrix asked for, built together in one job pool
+
+    std::string PgoPhase; // "instrument" or "use" from `--pgo=`, empty for a normal build
+    std::vector<std::string> PgoTraining; // Run against the instrumented build, see SetPgoTraining
+    std::vector<std::string> PgoCompileArgs; // Added to every compile / link by the current PGO phase
+    std::vector<std::string> PgoLinkArgs;
+    std::atomic<size_t> PgoUnprofiled{0}; // Functions the compiler reported without profile data, in files that have some
+    std::atomic<size_t> PgoUnprofiledFiles{0}; // Files the profile has no data for at all
+    const char* PgoStateName = ".obuild_pgo_state";
+
+    std::string LtoMode; // "full" or "thin" once EnableLTO turned it on, empty for no LTO
+    std::string LtoCache; // ThinLTO cache directory, absolute
+
+    std::string LinkerChoice; // UseLinker's "auto", "mold", "lld", "gold" or "bfd", empty for the compiler's default
+    std::string LinkerUsed; // What LinkerChoice came to on this machine, empty for the default, see Linker
+    bool LinkerChecked = false;
+    int LinkThreads = 1; // Threads each link is told to use, what it takes out of the job pool
+
+    /* Distributed compiles, off unless workers are set (OBJBUILD_WORKERS or AddWorker)
+            A compile is preprocessed here, the source goes to a worker with a free slot and the object comes back,
+            a worker that fails is dropped for the rest of the build and its compiles run here instead
+    */
+    typedef struct CompileWorker {
+        std::string address; // "unix:/path/to.sock" or "host:port"
+        int slots = 1; // Compiles it takes at once
+        int busy = 0;
+        bool dead = false;
+    } CompileWorker;
+    std::mutex WorkerLock;
+    std::vector<CompileWorker> Workers;
+    std::vector<int> JobWorker; // Job index -> worker it was given to, -1 for none, see RunJobs
+    std::unordered_map<std::string, std::string> CompilerKeys; // Compiler -> its `--version`, which a worker must match
+    std::atomic<size_t> RemoteCompiles{0};
+    std::atomic<size_t> RemoteFailovers{0};
+
+    std::string ArchiveMode = "full"; // SetArchiveMode's "full", "thin" or "incremental", see ArchiveUpdate
+
+    bool SplitDwarf = false; // SetDebugInfo's, .dwo files next to the objects instead of DWARF going through the link
+    bool CompressDebug = false; // Compressed debug sections
+    bool PackageDwarf = false; // A dwp job after each link gathers its .dwo files into <output>.dwp
+    bool SplitUsed = false; // Whether DebugFlags turned split debug info on for the jobs being queued
+
+    int ClangState = -1; // Whether the compiler is Clang, -1 until CompilerIsClang asks it
+    std::unordered_map<std::string, std::string> PchHeaders; // Target name -> header to precompile for it
+
+    UnityConfig GlobalUnity; // Unity build settings for targets without their own
+    std::unordered_map<std::string, UnityConfig> TargetUnity; // Target name -> its own unity build settings
+    std::unordered_map<std::string, std::unordered_set<std::string>> UnityExcludes; // Target name -> sources never merged
+
+    std::unordered_map<std::string, std::vector<std::string>> TargetDeps; // Target name -> libraries it links against
+
+    /* The directory index, kept in Obuild/.obuild_dirs
+            Every source directory a glob walked, with its modification time and what was in it
+            Adding, removing or renaming a file changes only its own directory's time, so only that directory is listed again
+    */
+    std::vector<SourceGlob> SourceGlobs;
+    std::unordered_map<std::string, DirListing> DirIndex; // Directory relative to BUILD.cpp ("" for its own) -> listing
+    std::unordered_set<std::string> DirsSeen; // Directories a glob looked at this run, the index keeps only these
+    bool DirIndexChanged = false;
+    size_t DirsListed = 0; // Directories read this run, the rest came from the index
+    const char* DirIndexName = ".obuild_dirs";
+    const uint32_t DirIndexVersion = 1;
+
+    std::vector<std::string> SplitBySpace(const std::string& input) { 
+                                                    // Split a std::string into a std::vector<std::string>
+        std::vector<std::string> result;
+        std::istringstream iss(input);
+        std::string token;
+        while (iss >> token) {
+            result.push_back(token);
+        }
+        return result;
+    }
+
+    uintmax_t ParseSize(const std::string& size){ // "500M" / "5G" / "1024K" / plain bytes
+        char* end = nullptr;
+        uintmax_t value = strtoull(size.c_str(), &end, 10);
+        if (end && (*end == 'K' || *end == 'k')) value *= 1024;
+        if (end && (*end == 'M' || *end == 'm')) value *= 1024 * 1024;
+        if (end && (*end == 'G' || *end == 'g')) value *= 1024 * 1024 * 1024;
+        return value;
+    }
+
+    bool EndsWith(const std::string& str, const std::string& suffix) {
+        return str.size() >= suffix.size() &&
+            str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+    std::string Join(const std::vector<std::string>& vec, const std::string& delim) { 
+                                                    // Join an std::vector<std::string> into a single std::string
+        std::string result;
+        for (size_t i = 0; i < vec.size(); ++i) {
+            result += vec[i];
+            if (i != vec.size() - 1) {
+                result += delim;
+            }
+        }
+        return result;
+    }
+    void SetPlatform(){ // Set platform based on compiler macros
+        #ifdef __APPLE__ 
+        Apple = true;
+        #endif 
+        #ifdef _WIN32
+        Windows = true;
+        #endif
+        #ifdef __gnu_linux__
+        Linux = true;
+        #endif
+        #ifdef __linux__ 
+        Linux = true;
+        #endif
+    }
+
+    void CheckBeforeAdd(){ // Check that build system is initialized, and building has not ran
+        if (!HasHead){
+            std::cerr << "Did not initialize system yet" << std::endl;
+            exit(1);
+        } else if (IsDone){
+            std::cerr << "Tried to add Target and/or Option after Configure Finished" << std::endl;
+            exit(1);
+        }
+    }
+
+
+    std::string StripBadChars(const std::string& input) {
+        std::string clean; // temp var
+        for (char ch : input) { // Loop through var and remove non-printable chars (\0 \n \t \r etc.)
+            if (isprint(static_cast<unsigned char>(ch))) clean += ch;
+        }
+
+        return clean;
+    }
+
+    void InsertCMD(std::vector<std::string> &Args){ // Put the compiler (which may be several words, e.g. "ccache gcc") first
+        std::vector<std::string> Compiler;
+        if (IsCXX){                            // Check if project has been set as C++
+            Compiler = SplitBySpace(StripBadChars(CXX));
+        } else if (IsC) {                      // Check if project has been set as C
+            Compiler = SplitBySpace(StripBadChars(CC));
+        } else {
+            std::cerr << "Project type not set" << std::endl; // Error if project type hasnt been set
+            exit(1);
+        }
+        Args.insert(Args.begin(), Compiler.begin(), Compiler.end());
+    }
+
+    void AppendOpts(std::vector<std::string> &Args, const std::vector<std::string> &Opts){ // Append options as separate arguments
+                                            // An option holding several words (like "/I ../include") becomes several arguments,
+                                            // the same split the shell used to do
+        for (auto &opt : Opts){
+            auto words = SplitBySpace(StripBadChars(opt));
+            Args.insert(Args.end(), words.begin(), words.end());
+        }
+    }
+
+    std::string ShowCommand(const std::vector<std::string>& argv){ // A command as one printable line, quoting arguments with spaces
+        std::string line;
+        for (auto &arg : argv){
+            if (!line.empty()) line += " ";
+            if (arg.find(' ') != std::string::npos) line += "\"" + arg + "\"";
+            else line += arg;
+        }
+        return line;
+    }
+
+    CmdResult RunCommand(const std::vector<std::string>& argv){ // Run a command and capture its stdout + stderr
+        CmdResult result;
+        if (argv.empty()) return result;
+        #ifdef _WIN32
+        // No posix_spawn here, go through the shell with a quoted command line
+        FILE* pipe = popen((ShowCommand(argv) + " 2>&1").c_str(), "r");
+        if (!pipe){
+            result.output = "Failed to run: " + ShowCommand(argv) + "\n";
+            return result;
+        }
+        char buf[4096];
+        while (fgets(buf, sizeof(buf), pipe)){
+            result.output += buf;
+        }
+        result.status = pclose(pipe);
+        #else
+        // Spawn the program directly, with one pipe collecting both stdout and stderr
+        std::vector<char*> cargv;
+        for (auto &arg : argv) cargv.push_back(const_cast<char*>(arg.c_str()));
+        cargv.push_back(nullptr);
+        int fds[2];
+        pid_t pid;
+        int rc;
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        {
+            // Another job spawning between pipe() and fcntl() would inherit our write end, and we'd never see EOF
+            std::lock_guard<std::mutex> lock(SpawnLock);
+            if (pipe(fds) != 0){
+                posix_spawn_file_actions_destroy(&actions);
+                result.output = "Failed to create pipe for: " + ShowCommand(argv) + "\n";
+                return result;
+            }
+            fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+            fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+            posix_spawn_file_actions_adddup2(&actions, fds[1], 1);
+            posix_spawn_file_actions_adddup2(&actions, fds[1], 2);
+            rc = posix_spawnp(&pid, cargv[0], &actions, nullptr, cargv.data(), environ);
+        }
+        posix_spawn_file_actions_destroy(&actions);
+        close(fds[1]);
+        if (rc != 0){
+            close(fds[0]);
+            result.output = "Failed to run " + argv[0] + ": " + strerror(rc) + "\n";
+            return result;
+        }
+        char buf[4096];
+        for (;;){
+            ssize_t got = read(fds[0], buf, sizeof(buf));
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) break;
+            result.output.append(buf, static_cast<size_t>(got));
+        }
+        close(fds[0]);
+        int status = 0;
+        struct rusage usage;
+        while (wait4(pid, &status, 0, &usage) < 0){ // Reap the child, along with the resources it used
+            if (errno != EINTR) return result;
+        }
+        if (WIFEXITED(status)) result.status = WEXITSTATUS(status);
+        result.usertime = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+        result.systime = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+        result.maxrss = usage.ru_maxrss;
+        #ifdef __APPLE__
+        result.maxrss /= 1024; // Bytes on macOS, KiB everywhere else
+        #endif
+        #endif
+        return result;
+    }
+
+    uint64_t CommandHash(const std::vector<std::string>& argv){ // Hash of a command, arguments kept apart so "a b" != "a" "b"
+                                                                 // Same as HashString of them joined by '\0', without the copy
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < argv.size(); i++){
+            if (i > 0) hash *= 1099511628211ULL; // ^= '\0' changes nothing
+            for (char ch : argv[i]){
+                hash ^= static_cast<unsigned char>(ch);
+                hash *= 1099511628211ULL;
+            }
+        }
+        return hash;
+    }
+
+    uint32_t DepPathId(const std::string& path){ // Intern a path in the dep store, DepLock must be held
+        auto found = DepPathIds.find(path);
+        if (found != DepPathIds.end()) return found->second;
+        uint32_t id = static_cast<uint32_t>(DepPaths.size());
+        DepPaths.push_back(path);
+        DepPathIds[path] = id;
+        return id;
+    }
+
+    bool ReadStore(const char* name, StoreReader& in){ // Read a whole store file into memory, false if there is none
+        std::ifstream file(name, std::ios::binary);
+        if (!file) return false;
+        std::stringstream text;
+        text << file.rdbuf();
+        in.data = text.str();
+        return true;
+    }
+    void ReadBytes(StoreReader& in, void* to, size_t len){ // Past the end (a truncated store) only clears `ok`
+        if (!in.ok || in.data.size() - in.pos < len){
+            in.ok = false;
+            return;
+        }
+        memcpy(to, in.data.data() + in.pos, len);
+        in.pos += len;
+    }
+    void ReadU32(StoreReader& in, uint32_t& val){ ReadBytes(in, &val, sizeof(val)); }
+    void WriteU32(std::ofstream& out, uint32_t val){ out.write(reinterpret_cast<const char*>(&val), sizeof(val)); }
+    void ReadU64(StoreReader& in, uint64_t& val){ ReadBytes(in, &val, sizeof(val)); }
+    void WriteU64(std::ofstream& out, uint64_t val){ out.write(reinterpret_cast<const char*>(&val), sizeof(val)); }
+
+    uint64_t HashString(const std::string& str){ // 64 bit FNV-1a
+        uint64_t hash = 14695981039346656037ULL;
+        for (char ch : str){
+            hash ^= static_cast<unsigned char>(ch);
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    void LoadDeps(){ /* Load the dep store, layout is
+                            "OBDEPS" version
+                            path count, then each path as length + bytes
+                            record count, then each record as output path id, dep count, dep path ids
+                        A missing, old or damaged store is just dropped, so everything gets rebuilt once
+                     */
+        StoreReader in;
+        if (!ReadStore(DepStoreName, in)) return;
+        char magic[6];
+        uint32_t version = 0, npaths = 0, nrecords = 0;
+        ReadBytes(in, magic, sizeof(magic));
+        ReadU32(in, version);
+        if (!in.ok || std::string(magic, sizeof(magic)) != "OBDEPS" || version != DepStoreVersion) return;
+        ReadU32(in, npaths);
+        std::vector<uint32_t> pathIds; // Id in the store file -> id in DepPaths
+        pathIds.reserve(npaths < in.data.size() ? npaths : 0);
+        DepPaths.reserve(pathIds.capacity());
+        DepPathIds.reserve(pathIds.capacity());
+        for (uint32_t i = 0; in.ok && i < npaths; i++){
+            uint32_t len = 0;
+            ReadU32(in, len);
+            std::string path(len < in.data.size() ? len : 0, '\0');
+            ReadBytes(in, &path[0], len);
+            pathIds.push_back(DepPathId(path));
+        }
+        ReadU32(in, nrecords);
+        DepRecords.reserve(nrecords < in.data.size() ? nrecords : 0);
+        for (uint32_t i = 0; in.ok && i < nrecords; i++){
+            uint32_t oid = 0, ndeps = 0;
+            ReadU32(in, oid);
+            ReadU32(in, ndeps);
+            std::vector<uint32_t> ids;
+            for (uint32_t d = 0; in.ok && d < ndeps; d++){
+                uint32_t id = 0;
+                ReadU32(in, id);
+                if (id < pathIds.size()) ids.push_back(pathIds[id]);
+            }
+            if (in.ok && oid < pathIds.size()) DepRecords[DepPaths[pathIds[oid]]] = std::move(ids);
+        }
+        if (!in.ok){ // Truncated, don't trust any of it
+            DepStatIds.clear();
+            DepPaths.clear();
+            DepPathIds.clear();
+            DepRecords.clear();
+        }
+    }
+
+    void SaveDeps(){ // Write the dep store, only paths still referenced by a record are kept
+        std::vector<std::string> paths;
+        std::unordered_map<uint32_t, uint32_t> remap;
+        auto newId = [&](uint32_t id){
+            auto found = remap.find(id);
+            if (found != remap.end()) return found->second;
+            uint32_t nid = static_cast<uint32_t>(paths.size());
+            paths.push_back(DepPaths[id]);
+            remap[id] = nid;
+            return nid;
+        };
+        std::vector<std::pair<uint32_t, std::vector<uint32_t>>> records;
+        for (auto &rec : DepRecords){
+            std::vector<uint32_t> ids;
+            for (auto id : rec.second) ids.push_back(newId(id));
+            records.push_back({newId(DepPathId(rec.first)), ids});
+        }
+        std::string tmpName = std::string(DepStoreName) + ".tmp";
+        std::ofstream out(tmpName, std::ios::binary | std::ios::trunc);
+        out.write("OBDEPS", 6);
+        WriteU32(out, DepStoreVersion);
+        WriteU32(out, static_cast<uint32_t>(paths.size()));
+        for (auto &path : paths){
+            WriteU32(out, static_cast<uint32_t>(path.size()));
+            out.write(path.data(), path.size());
+        }
+        WriteU32(out, static_cast<uint32_t>(records.size()));
+        for (auto &rec : records){
+            WriteU32(out, rec.first);
+            WriteU32(out, static_cast<uint32_t>(rec.second.size()));
+            for (auto id : rec.second) WriteU32(out, id);
+        }
+        out.close();
+        std::error_code ec;
+        std::filesystem::rename(tmpName, DepStoreName, ec); // Replace in one step so a killed build can't leave half a store
+    }
+
+    void LoadLog(){ /* Load the build log, layout is
+                            "OBLOG" version
+                            entry count, then each entry as path length + bytes, command hash, input stamp, peak memory, duration
+                        Like the dep store, anything unreadable is dropped and rebuilt
+                    */
+        StoreReader in;
+        if (!ReadStore(BuildLogName, in)) return;
+        char magic[5];
+        uint32_t version = 0, nentries = 0;
+        ReadBytes(in, magic, sizeof(magic));
+        ReadU32(in, version);
+        if (!in.ok || std::string(magic, sizeof(magic)) != "OBLOG" || version != BuildLogVersion) return;
+        ReadU32(in, nentries);
+        std::unordered_map<std::string, LogEntry> entries;
+        entries.reserve(nentries < in.data.size() ? nentries : 0);
+        for (uint32_t i = 0; in.ok && i < nentries; i++){
+            uint32_t len = 0;
+            uint64_t cmdhash = 0, inputstamp = 0, maxrss = 0, duration = 0;
+            ReadU32(in, len);
+            std::string path(len < in.data.size() ? len : 0, '\0');
+            ReadBytes(in, &path[0], len);
+            ReadU64(in, cmdhash);
+            ReadU64(in, inputstamp);
+            ReadU64(in, maxrss);
+            ReadU64(in, duration);
+            entries[path] = {cmdhash, static_cast<int64_t>(inputstamp), maxrss, duration};
+        }
+        if (in.ok) BuildLog = std::move(entries);
+    }
+
+    void SaveLog(){ // Write the build log
+        std::lock_guard<std::mutex> lock(LogLock);
+        std::string tmpName = std::string(BuildLogName) + ".tmp";
+        std::ofstream out(tmpName, std::ios::binary | std::ios::trunc);
+        out.write("OBLOG", 5);
+        WriteU32(out, BuildLogVersion);
+        WriteU32(out, static_cast<uint32_t>(BuildLog.size()));
+        for (auto &entry : BuildLog){
+            WriteU32(out, static_cast<uint32_t>(entry.first.size()));
+            out.write(entry.first.data(), entry.first.size());
+            WriteU64(out, entry.second.cmdhash);
+            WriteU64(out, static_cast<uint64_t>(entry.second.inputstamp));
+            WriteU64(out, entry.second.maxrss);
+            WriteU64(out, entry.second.duration);
+        }
+        out.close();
+        std::error_code ec;
+        std::filesystem::rename(tmpName, BuildLogName, ec);
+    }
+
+    void LoadDirIndex(){ /* Load the directory index, layout is
+                                "OBDIRS" version
+                                directory count, then each directory as path length + bytes, modification time,
+                                file count + each name as length + bytes, subdirectory count + each name the same way
+                            Anything unreadable is dropped, and every directory is listed again
+                        */
+        StoreReader in;
+        if (!ReadStore(DirIndexName, in)) return;
+        char magic[6];
+        uint32_t version = 0, ndirs = 0;
+        ReadBytes(in, magic, sizeof(magic));
+        ReadU32(in, version);
+        if (!in.ok || std::string(magic, sizeof(magic)) != "OBDIRS" || version != DirIndexVersion) return;
+        auto readName = [&](){
+            uint32_t len = 0;
+            ReadU32(in, len);
+            std::string name(len < in.data.size() ? len : 0, '\0');
+            ReadBytes(in, &name[0], len);
+            return name;
+        };
+        std::unordered_map<std::string, DirListing> index;
+        ReadU32(in, ndirs);
+        for (uint32_t i = 0; in.ok && i < ndirs; i++){
+            std::string path = readName();
+            DirListing listing;
+            uint64_t mtime = 0;
+            uint32_t count = 0;
+            ReadU64(in, mtime);
+            listing.mtime = static_cast<int64_t>(mtime);
+            ReadU32(in, count);
+            for (uint32_t f = 0; in.ok && f < count; f++) listing.files.push_back(readName());
+            ReadU32(in, count);
+            for (uint32_t d = 0; in.ok && d < count; d++) listing.dirs.push_back(readName());
+            index[path] = std::move(listing);
+        }
+        if (in.ok) DirIndex = std::move(index);
+    }
+
+    void SaveDirIndex(){ // Write the directory index
+        std::string tmpName = std::string(DirIndexName) + ".tmp";
+        std::ofstream out(tmpName, std::ios::binary | std::ios::trunc);
+        auto writeName = [&](const std::string& name){
+            WriteU32(out, static_cast<uint32_t>(name.size()));
+            out.write(name.data(), name.size());
+        };
+        out.write("OBDIRS", 6);
+        WriteU32(out, DirIndexVersion);
+        WriteU32(out, static_cast<uint32_t>(DirIndex.size()));
+        for (auto &dir : DirIndex){
+            writeName(dir.first);
+            WriteU64(out, static_cast<uint64_t>(dir.second.mtime));
+            WriteU32(out, static_cast<uint32_t>(dir.second.files.size()));
+            for (auto &name : dir.second.files) writeName(name);
+            WriteU32(out, static_cast<uint32_t>(dir.second.dirs.size()));
+            for (auto &name : dir.second.dirs) writeName(name);
+        }
+        out.close();
+        std::error_code ec;
+        std::filesystem::rename(tmpName, DirIndexName, ec);
+    }
+
+    std::vector<std::string> ParseDepFile(const std::string& text){ // Parse a Makefile style `-MMD` depfile
+                                        // e.g. "obj.o: ../src/a.c ../include/b\ c.h", lines continued with a backslash
+        std::vector<std::string> deps;
+        size_t pos = text.find(": "); // Skip the target, the space keeps Windows drive letters intact
+        if (pos == std::string::npos) return deps;
+        std::string cur;
+        for (size_t i = pos + 2; i < text.size(); i++){
+            char ch = text[i];
+            if (ch == '\\' && i + 1 < text.size() && (text[i + 1] == '\n' || text[i + 1] == '\r')){
+                continue; // Line continuation, the newline itself ends the token below
+            } else if (ch == '\\' && i + 1 < text.size() && text[i + 1] == ' '){
+                cur += ' '; // Escaped space inside a path
+                i++;
+            } else if (ch == '$' && i + 1 < text.size() && text[i + 1] == '$'){
+                cur += '$';
+                i++;
+            } else if (isspace(static_cast<unsigned char>(ch))){
+                if (!cur.empty()) deps.push_back(cur);
+                cur.clear();
+            } else {
+                cur += ch;
+            }
+        }
+        if (!cur.empty()) deps.push_back(cur);
+        return deps;
+    }
+
+    void RecordDeps(const Job& job, CmdResult& result){ // Move a finished compile's dependencies into the dep store
+        std::vector<std::string> deps;
+        std::string& output = result.output;
+        bool found = false;
+        if (!IsMSVC){
+            std::string depName = job.output + ".d";
+            std::ifstream in(depName, std::ios::binary);
+            if (in){
+                std::stringstream text;
+                text << in.rdbuf();
+                in.close();
+                deps = ParseDepFile(text.str());
+                found = true;
+                std::error_code ec;
+                std::filesystem::remove(depName, ec); // The store has it now
+            }
+        } else { // `/showIncludes` prints one "Note: including file:" line per header, take them out of the output
+            const std::string note = "Note: including file:";
+            std::string kept;
+            std::istringstream lines(output);
+            std::string line;
+            deps = job.inputs;
+            found = true;
+            while (std::getline(lines, line)){
+                size_t npos = line.find(note);
+                if (npos != std::string::npos){
+                    size_t start = line.find_first_not_of(" ", npos + note.size());
+                    if (start != std::string::npos){
+                        std::string header = line.substr(start);
+                        if (!header.empty() && header.back() == '\r') header.pop_back();
+                        deps.push_back(header);
+                    }
+                } else {
+                    kept += line + "\n";
+                }
+            }
+            output = kept;
+        }
+        std::lock_guard<std::mutex> lock(DepLock);
+        if (!found || result.status != 0){ // The compile failed, forget the old record so it's retried
+            DepRecords.erase(job.output);
+            return;
+        }
+        std::vector<uint32_t> ids;
+        for (auto &dep : deps) ids.push_back(DepPathId(dep));
+        DepRecords[job.output] = ids;
+    }
+
+    bool JobInputs(const Job& job, std::vector<std::string>& inputs){ // Every input of a job, including recorded headers
+                                                                       // False when a compile has no dep record yet
+        inputs = job.inputs;
+        if (job.deps){
+            std::lock_guard<std::mutex> lock(DepLock);
+            auto rec = DepRecords.find(job.output);
+            if (rec == DepRecords.end()) return false;
+            for (auto id : rec->second) inputs.push_back(DepPaths[id]);
+        }
+        return true;
+    }
+
+    bool StatAt(int dirfd, const std::string& dir, const char* name, int64_t& mtime){
+        /* One stat syscall, `name` relative to the open directory `dirfd` (`dir` is only used where there are no fds)
+                statx on Linux asks for just the modification time, fstatat elsewhere
+        */
+        StatCalls++;
+        #ifdef _WIN32
+        (void)dirfd;
+        std::error_code ec;
+        auto time = std::filesystem::last_write_time(std::filesystem::path(dir) / name, ec);
+        if (ec) return false;
+        mtime = static_cast<int64_t>(time.time_since_epoch().count()); // Not 1970 based, but only ever compared with itself
+        return true;
+        #else
+        (void)dir;
+        #if defined(__linux__) && defined(STATX_MTIME)
+        struct statx stx;
+        if (statx(dirfd, name, AT_STATX_DONT_SYNC, STATX_MTIME, &stx) != 0) return false;
+        mtime = static_cast<int64_t>(stx.stx_mtime.tv_sec) * 1000000000 + stx.stx_mtime.tv_nsec;
+        #else
+        struct stat st;
+        if (fstatat(dirfd, name, &st, 0) != 0) return false;
+        #ifdef __APPLE__
+        mtime = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+        #else
+        mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        #endif
+        #endif
+        return true;
+        #endif
+    }
+
+    void SplitPath(const std::string& path, std::string& dir, std::string& name){ // "../src/a.c" -> "../src" + "a.c"
+        size_t slash = path.find_last_of(Windows ? "/\\" : "/");
+        if (slash == std::string::npos){
+            dir = "";
+            name = path;
+        } else {
+            dir = path.substr(0, slash == 0 ? 1 : slash); // Keep "/" itself
+            name = path.substr(slash + 1);
+        }
+    }
+
+    int OpenDir(const std::string& dir, std::unordered_map<std::string, int>& fds){
+        /* Open a directory relative to its (already opened) parent, so "../src/util" costs one openat
+                once "../src" is open, returns AT_FDCWD for "" and -1 if it doesn't exist
+        */
+        #ifdef _WIN32
+        (void)dir; (void)fds;
+        return -1;
+        #else
+        if (dir.empty()) return AT_FDCWD;
+        auto found = fds.find(dir);
+        if (found != fds.end()) return found->second;
+        int fd;
+        std::string parent, leaf;
+        SplitPath(dir, parent, leaf);
+        if (dir == "/"){
+            fd = open("/", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        } else {
+            int pfd = OpenDir(parent, fds);
+            fd = pfd == -1 ? -1 : openat(pfd, leaf.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        }
+        if (fd != -1) DirOpens++;
+        fds[dir] = fd;
+        return fd;
+        #endif
+    }
+
+    uint32_t StatId(const std::string& path){ // Index of a path in the file table, added unstat'ed if new, StatLock must be held
+        auto found = StatIds.find(path);
+        if (found != StatIds.end()) return found->second;
+        uint32_t id = static_cast<uint32_t>(StatTable.size());
+        StatTable.emplace_back();
+        StatPaths.push_back(&StatIds.emplace(path, id).first->first);
+        return id;
+    }
+
+    bool InputIds(const Job& job, std::vector<uint32_t>& ids){ // JobInputs as file table indexes, StatLock must be held
+                                                                // A header is looked up once per run, not once per includer
+        ids.clear();
+        for (auto &in : job.inputs) ids.push_back(StatId(in));
+        if (!job.deps) return true;
+        std::lock_guard<std::mutex> lock(DepLock);
+        auto rec = DepRecords.find(job.output);
+        if (rec == DepRecords.end()) return false;
+        if (DepStatIds.size() < DepPaths.size()) DepStatIds.resize(DepPaths.size(), UINT32_MAX);
+        for (auto id : rec->second){
+            if (DepStatIds[id] == UINT32_MAX) DepStatIds[id] = StatId(DepPaths[id]);
+            ids.push_back(DepStatIds[id]);
+        }
+        return true;
+    }
+
+    void ScanFiles(const std::vector<Job>& jobs){
+        /* Stat every output and input of every job (recorded headers included) in one pass
+                Paths are grouped by directory, each directory is opened once and its files are stat'ed relative to it,
+                large builds split the directories over the job pool's threads
+        */
+        auto Start = std::chrono::steady_clock::now();
+        uint32_t first, count; // Paths already in the table (like source directories a glob looked at) keep their state
+        {
+            std::lock_guard<std::mutex> lock(StatLock);
+            first = static_cast<uint32_t>(StatTable.size());
+            std::vector<uint32_t> ids;
+            for (auto &job : jobs){
+                StatId(job.output);
+                InputIds(job, ids);
+            }
+            count = static_cast<uint32_t>(StatTable.size()) - first; // Everything new went to the end of the table
+        }
+        std::map<std::string, std::vector<std::pair<uint32_t, std::string>>> ByDir; // Directory -> (table index, file name)
+        for (uint32_t id = 0; id < count; id++){
+            std::string dir, name;
+            SplitPath(*StatPaths[first + id], dir, name);
+            ByDir[dir].push_back({id, name});
+        }
+        std::unordered_map<std::string, int> fds;
+        std::vector<std::pair<int, const std::pair<const std::string, std::vector<std::pair<uint32_t, std::string>>>*>> Dirs;
+        for (auto &dir : ByDir){
+            Dirs.push_back({OpenDir(dir.first, fds), &dir});
+        }
+        std::vector<FileState> Found(count);
+        std::atomic<size_t> next(0);
+        auto worker = [&](){
+            for (size_t d = next++; d < Dirs.size(); d = next++){
+                for (auto &file : Dirs[d].second->second){
+                    FileState &fs = Found[file.first];
+                    fs.state = 2;
+                    #ifndef _WIN32
+                    if (Dirs[d].first == -1) continue; // The whole directory is missing
+                    #endif
+                    if (StatAt(Dirs[d].first, Dirs[d].second->first, file.second.c_str(), fs.mtime)) fs.state = 1;
+                }
+            }
+        };
+        size_t nthreads = (std::min)(static_cast<size_t>(Jobs), static_cast<size_t>(count / 2048 + 1)); // Threads only pay off for big trees
+        std::vector<std::thread> threads;
+        for (size_t t = 1; t < nthreads; t++) threads.emplace_back(worker);
+        worker();
+        for (auto &th : threads) th.join();
+        #ifndef _WIN32
+        for (auto &fd : fds){
+            if (fd.second >= 0) close(fd.second);
+        }
+        #endif
+        {
+            std::lock_guard<std::mutex> lock(StatLock);
+            for (uint32_t id = 0; id < count; id++) StatTable[first + id] = Found[id];
+        }
+        ScanTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+    }
+
+    bool TableTime(uint32_t id, int64_t& mtime, bool fresh = false){
+        /* Modification time of a file from the file table, false if it doesn't exist, StatLock must be held
+                Paths the scan didn't see (headers a compile just reported) are stat'ed once here,
+                `fresh` stats again, for an output a job just wrote
+        */
+        FileState &fs = StatTable[id];
+        if (fs.state == 0 || fresh){
+            const std::string &path = *StatPaths[id];
+            std::string dir, name;
+            SplitPath(path, dir, name);
+            #ifdef _WIN32
+            fs.state = StatAt(-1, dir, name.c_str(), fs.mtime) ? 1 : 2;
+            #else
+            fs.state = StatAt(AT_FDCWD, dir, path.c_str(), fs.mtime) ? 1 : 2;
+            #endif
+        }
+        mtime = fs.mtime;
+        return fs.state == 1;
+    }
+
+    bool FileTime(const std::string& path, int64_t& mtime, bool fresh = false){ // TableTime by path
+        std::lock_guard<std::mutex> lock(StatLock);
+        return TableTime(StatId(path), mtime, fresh);
+    }
+
+    bool InputStamp(const std::vector<std::string>& inputs, int64_t& newest){ // Newest modification time of the inputs
+                                                                               // False if one of them is missing
+        newest = INT64_MIN;
+        for (auto &in : inputs){
+            int64_t stamp;
+            if (!FileTime(in, stamp)) return false;
+            if (stamp > newest) newest = stamp;
+        }
+        return true;
+    }
+
+    bool IsUpToDate(const Job& job){ // True when the job's output exists, was built with the same command
+                                     // and none of its inputs changed since
+        UpToDateChecks++;
+        int64_t otime, stamp = INT64_MIN;
+        {
+            std::lock_guard<std::mutex> lock(StatLock); // One lock and no path copies per job, a no-op build checks every job
+            if (!TableTime(StatId(job.output), otime)) return false; // No output yet
+            std::vector<uint32_t> ids;
+            if (!InputIds(job, ids)) return false; // An object without a dep record can't be trusted
+            for (auto id : ids){
+                int64_t mtime;
+                if (!TableTime(id, mtime)) return false; // Missing inputs (like a deleted header) mean a rebuild
+                if (mtime > stamp) stamp = mtime;
+            }
+        }
+        if (stamp > otime) return false;
+        std::lock_guard<std::mutex> lock(LogLock);
+        auto entry = BuildLog.find(job.output);
+        if (entry == BuildLog.end()) return false; // Never built by us, so the command is unknown
+        return entry->second.cmdhash == CommandHash(job.argv) && entry->second.inputstamp == stamp;
+    }
+
+    std::string HexKey(const std::string& data){ // 128 bit key for the compiler cache, two FNV-1a passes with different offsets
+        uint64_t first = 14695981039346656037ULL, second = 0x6c62272e07bb0142ULL;
+        for (char ch : data){
+            first ^= static_cast<unsigned char>(ch);
+            first *= 1099511628211ULL;
+            second ^= static_cast<unsigned char>(ch);
+            second *= 1099511628211ULL;
+            second ^= second >> 29; // Keep the two passes from moving in step
+        }
+        std::ostringstream key;
+        key << std::hex << std::setw(16) << std::setfill('0') << first << std::setw(16) << std::setfill('0') << second;
+        return key.str();
+    }
+
+    std::string FindProgram(const std::string& name){ // Where `name` would run from, searching PATH, empty if nowhere
+        std::error_code ec;
+        if (name.find('/') != std::string::npos) return std::filesystem::exists(name, ec) ? name : "";
+        const char* pathEnv = getenv("PATH");
+        if (!pathEnv) return "";
+        std::istringstream dirs(pathEnv);
+        std::string dir;
+        while (std::getline(dirs, dir, Windows ? ';' : ':')){
+            if (dir.empty()) continue;
+            std::filesystem::path found = std::filesystem::path(dir) / name;
+            if (std::filesystem::exists(found, ec)) return found.string();
+            if (Windows && std::filesystem::exists(found.string() + ".exe", ec)) return found.string() + ".exe";
+        }
+        return "";
+    }
+
+    std::string CompilerIdentity(const std::string& compiler){ // Resolved path, size and time of the compiler binary
+                                                               // so upgrading the compiler never reuses old objects
+        std::lock_guard<std::mutex> lock(CacheLock);
+        auto found = CompilerIds.find(compiler);
+        if (found != CompilerIds.end()) return found->second;
+        std::filesystem::path resolved = compiler;
+        std::error_code ec;
+        if (!FindProgram(compiler).empty()) resolved = FindProgram(compiler);
+        resolved = std::filesystem::canonical(resolved, ec);
+        std::ostringstream id;
+        id << resolved.string() << ":" << std::filesystem::file_size(resolved, ec) << ":"
+           << std::filesystem::last_write_time(resolved, ec).time_since_epoch().count();
+        CompilerIds[compiler] = id.str();
+        return id.str();
+    }
+
+    bool AsksForDebugInfo(const std::vector<std::string>& Flags){ // Whether compiler flags turn debug info on, the last -g level wins
+        bool Debug = false;
+        for (auto &flag : Flags){
+            if (flag == "-g0") Debug = false;
+            else if (flag == "-g" || flag == "-g1" || flag == "-g2" || flag == "-g3" || flag.rfind("-ggdb", 0) == 0 || flag.rfind("-gdwarf", 0) == 0) Debug = true;
+        }
+        return Debug;
+    }
+
+    bool CacheFetch(const Job& job, CmdResult& result, bool keep = false){ /* Try to take the job's object from the compiler cache
+                                                                                   Runs the preprocessor (which also writes the depfile) and on a hit
+                                                                                   links or copies the cached object into place
+                                                                                   `keep` leaves the preprocessed source for RemoteCompile on a miss
+                                                                             */
+        CmdResult pre = RunCommand(job.preargv);
+        std::string iname = job.output + ".i";
+        std::ifstream in(iname, std::ios::binary);
+        if (pre.status != 0 || !in) return false; // Let the real compile report the problem
+        std::stringstream text;
+        text << in.rdbuf();
+        in.close();
+        std::error_code ec;
+        if (!keep) std::filesystem::remove(iname, ec);
+        std::string where; // Debug info records the build directory (DW_AT_comp_dir) unless a prefix map rewrites it
+        if (AsksForDebugInfo(job.argv)){
+            where = std::filesystem::current_path(ec).string();
+            for (auto &arg : job.argv){
+                if (arg.rfind("-fdebug-prefix-map=", 0) == 0 || arg.rfind("-ffile-prefix-map=", 0) == 0 ||
+                    arg.rfind("-fdebug-compilation-dir", 0) == 0) where.clear();
+            }
+        }
+        std::string key = HexKey(CompilerIdentity(job.argv[0]) + '\0' + Join(job.argv, std::string(1, '\0')) + '\0' + where + '\0' + text.str());
+        std::filesystem::path entry = std::filesystem::path(CacheDir) / key.substr(0, 2) / key;
+        {
+            std::lock_guard<std::mutex> lock(CacheLock);
+            JobCacheKeys[job.output] = entry.string(); // Remember where a miss gets stored
+        }
+        std::filesystem::path cached = entry.string() + ".o";
+        if (!std::filesystem::exists(cached, ec)){
+            CacheMisses++;
+            return false;
+        }
+        if (keep) std::filesystem::remove(iname, ec);
+        std::filesystem::remove(job.output, ec);
+        std::filesystem::create_hard_link(cached, job.output, ec);
+        if (ec){ // Different filesystem, or no hardlinks
+            ec.clear();
+            std::filesystem::copy_file(cached, job.output, std::filesystem::copy_options::overwrite_existing, ec);
+            if (ec){
+                CacheMisses++;
+                return false;
+            }
+        }
+        // Fresh time on the object (and, when linked, on the entry too, marking it recently used)
+        std::filesystem::last_write_time(job.output, std::filesystem::file_time_type::clock::now(), ec);
+        std::ifstream saved(entry.string() + ".txt", std::ios::binary);
+        if (saved){ // Replay the warnings the compile printed
+            std::stringstream out;
+            out << saved.rdbuf();
+            result.output = out.str();
+        }
+        result.status = 0;
+        CacheHits++;
+        return true;
+    }
+
+    void CacheStore(const Job& job, const CmdResult& result){ // Put a freshly compiled object into the compiler cache
+        std::string entry;
+        {
+            std::lock_guard<std::mutex> lock(CacheLock);
+            auto found = JobCacheKeys.find(job.output);
+            if (found == JobCacheKeys.end()) return;
+            entry = found->second;
+        }
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(entry).parent_path(), ec);
+        std::string tmp = entry + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        std::filesystem::copy_file(job.output, tmp, std::filesystem::copy_options::overwrite_existing, ec);
+        if (ec) return;
+        std::ofstream out(entry + ".txt", std::ios::binary | std::ios::trunc);
+        out << result.output;
+        out.close();
+        std::filesystem::rename(tmp, entry + ".o", ec); // Readers only ever see whole objects
+        CacheStores++;
+    }
+
+    void CacheFinish(){ /* Update the cache's stats and evict the least recently used entries past CacheSize
+                                Stats are kept in <CacheDir>/stats as "hits misses"
+                        */
+        size_t hits = 0, misses = 0;
+        std::string statsName = (std::filesystem::path(CacheDir) / "stats").string();
+        std::ifstream in(statsName);
+        if (in) in >> hits >> misses;
+        in.close();
+        hits += CacheHits;
+        misses += CacheMisses;
+        std::error_code ec;
+        std::filesystem::create_directories(CacheDir, ec);
+        std::ofstream out(statsName, std::ios::trunc);
+        out << hits << " " << misses << std::endl;
+        out.close();
+
+        uintmax_t total = 0;
+        std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> objs;
+        for (auto it = std::filesystem::recursive_directory_iterator(CacheDir, ec);
+             !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)){
+            if (!it->is_regular_file(ec) || it->path().extension() != ".o") continue;
+            total += it->file_size(ec);
+            objs.push_back({it->last_write_time(ec), it->path()});
+        }
+        if (total > CacheSize){ // Evict oldest first, down to 90% so we don't evict again next build
+            std::sort(objs.begin(), objs.end());
+            for (auto &obj : objs){
+                if (total <= CacheSize / 10 * 9) break;
+                total -= std::filesystem::file_size(obj.second, ec);
+                std::filesystem::remove(obj.second, ec);
+                std::filesystem::path txt = obj.second;
+                std::filesystem::remove(txt.replace_extension(".txt"), ec);
+            }
+        }
+        std::cout << "Cache: " << CacheHits << " hit(s), " << CacheMisses << " miss(es) this build, "
+                  << hits << " hit(s), " << misses << " miss(es) total, "
+                  << total / (1024 * 1024) << " of " << CacheSize / (1024 * 1024) << " MiB used" << std::endl;
+    }
+
+    double SinceStart(){ // Seconds since DoBuild started
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - BuildStart).count();
+    }
+
+    void PutU32(std::string& out, uint32_t val){ out.append(reinterpret_cast<const char*>(&val), sizeof(val)); }
+    void PutU64(std::string& out, uint64_t val){ out.append(reinterpret_cast<const char*>(&val), sizeof(val)); }
+    void PutString(std::string& out, const std::string& str){ // Length, then the bytes
+        PutU64(out, str.size());
+        out.append(str);
+    }
+    void ReadString(StoreReader& in, std::string& str){
+        uint64_t len = 0;
+        ReadU64(in, len);
+        str.assign(len <= in.data.size() - in.pos ? len : 0, '\0');
+        if (len > in.data.size() - in.pos) in.ok = false;
+        else ReadBytes(in, &str[0], len);
+    }
+
+    #ifndef _WIN32
+    int CloexecSocket(int domain, int type, int protocol){ // A socket no command spawned meanwhile inherits
+        #ifdef SOCK_CLOEXEC
+        return socket(domain, type | SOCK_CLOEXEC, protocol);
+        #else
+        std::lock_guard<std::mutex> lock(SpawnLock); // No SOCK_CLOEXEC (macOS), keep spawns out until it's set, see RunCommand
+        int fd = socket(domain, type, protocol);
+        if (fd >= 0) fcntl(fd, F_SETFD, FD_CLOEXEC);
+        return fd;
+        #endif
+    }
+
+    int CloexecAccept(int listener){ // The next connection, as a socket no command spawned meanwhile inherits
+        #ifdef __linux__
+        return accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        #else
+        pollfd ready{listener, POLLIN, 0}; // Wait outside SpawnLock, then take the connection without blocking under it
+        if (poll(&ready, 1, -1) <= 0) return -1;
+        fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+        std::lock_guard<std::mutex> lock(SpawnLock);
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd >= 0){
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK); // BSD accept() copies O_NONBLOCK from the listener
+        }
+        return fd;
+        #endif
+    }
+    #endif
+
+    int OpenSocket(const std::string& address, bool server, std::string& error){
+        /* A socket connected to (or, for `server`, listening on) a worker address, -1 with `error` set if that failed
+                "unix:/path/to.sock" is a Unix socket, anything else "host:port" ("[::1]:port" for IPv6)
+        */
+        #ifndef _WIN32
+        int fd = -1;
+        if (address.rfind("unix:", 0) == 0){
+            sockaddr_un local{};
+            std::string path = address.substr(5);
+            if (path.empty() || path.size() >= sizeof(local.sun_path)){
+                error = "bad socket path";
+                return -1;
+            }
+            local.sun_family = AF_UNIX;
+            memcpy(local.sun_path, path.c_str(), path.size() + 1);
+            fd = CloexecSocket(AF_UNIX, SOCK_STREAM, 0);
+            if (server) unlink(path.c_str()); // Left behind by a worker that was killed
+            if (fd >= 0 && (server ? bind(fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) == 0 && listen(fd, 128) == 0
+                                   : connect(fd, reinterpret_cast<sockaddr*>(&local), sizeof(local)) == 0)) return fd;
+        } else {
+            size_t colon = address.rfind(':');
+            if (colon == std::string::npos){
+                error = "no port";
+                return -1;
+            }
+            std::string host = address.substr(0, colon), port = address.substr(colon + 1);
+            if (host.size() > 1 && host.front() == '[' && host.back() == ']') host = host.substr(1, host.size() - 2);
+            addrinfo hints{}, *found = nullptr;
+            hints.ai_socktype = SOCK_STREAM;
+            hints.ai_flags = server ? AI_PASSIVE : 0;
+            int gai = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &found);
+            if (gai != 0){
+                error = gai_strerror(gai);
+                return -1;
+            }
+            for (addrinfo* at = found; at; at = at->ai_next){
+                fd = CloexecSocket(at->ai_family, at->ai_socktype, at->ai_protocol);
+                if (fd < 0) continue;
+                int one = 1;
+                if (server) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+                if (server ? bind(fd, at->ai_addr, at->ai_addrlen) == 0 && listen(fd, 128) == 0
+                           : connect(fd, at->ai_addr, at->ai_addrlen) == 0) break;
+                close(fd);
+                fd = -1;
+            }
+            freeaddrinfo(found);
+            if (fd >= 0) return fd;
+        }
+        error = strerror(errno);
+        if (fd >= 0) close(fd);
+        #else
+        (void)address;
+        (void)server;
+        error = "not supported on Windows";
+        #endif
+        return -1;
+    }
+
+    bool SendAll(int fd, const std::string& data){ // Write all of `data` to a socket
+        #ifndef _WIN32
+        #ifdef MSG_NOSIGNAL
+        const int Flags = MSG_NOSIGNAL; // A peer that went away is an error, not SIGPIPE
+        #else
+        const int Flags = 0;
+        #endif
+        for (size_t done = 0; done < data.size();){
+            ssize_t n = send(fd, data.data() + done, data.size() - done, Flags);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            done += static_cast<size_t>(n);
+        }
+        return true;
+        #else
+        (void)fd;
+        (void)data;
+        return false;
+        #endif
+    }
+
+    bool ReceiveAll(int fd, std::string& data){ // Read a socket until the other end is done sending
+        #ifndef _WIN32
+        char buf[65536];
+        for (;;){
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) return false;
+            if (n == 0) return true;
+            data.append(buf, static_cast<size_t>(n));
+        }
+        #else
+        (void)fd;
+        (void)data;
+        return false;
+        #endif
+    }
+
+    std::string CompilerKey(const std::string& compiler){ // What `compiler --version` says, a worker only compiles for the same one
+        {
+            std::lock_guard<std::mutex> lock(WorkerLock);
+            auto found = CompilerKeys.find(compiler);
+            if (found != CompilerKeys.end()) return found->second;
+        }
+        std::string key = RunCommand({compiler, "--version"}).output;
+        std::lock_guard<std::mutex> lock(WorkerLock);
+        return CompilerKeys.emplace(compiler, key).first->second;
+    }
+
+    std::string WorkerAddress(const std::string& address){ // A Unix socket's path made absolute, the build runs from Obuild
+        if (address.rfind("unix:", 0) != 0 || address.size() < 6 || address[5] == '/') return address;
+        return "unix:" + std::filesystem::absolute(address.substr(5)).string();
+    }
+
+    void AddWorkers(const std::string& list){ /* Workers from OBJBUILD_WORKERS, "address*slots" separated by commas or spaces,
+                                                       e.g. "unix:/tmp/objbuild.sock*4,buildbox:7070*16" (no "*slots" is 1)
+                                               */
+        std::string item;
+        std::istringstream items(list);
+        while (items >> item){
+            std::istringstream parts(item);
+            std::string entry;
+            while (std::getline(parts, entry, ',')){
+                if (entry.empty()) continue;
+                size_t star = entry.rfind('*');
+                CompileWorker worker;
+                worker.address = WorkerAddress(entry.substr(0, star));
+                if (star != std::string::npos) worker.slots = (std::max)(atoi(entry.c_str() + star + 1), 1);
+                Workers.push_back(worker);
+            }
+        }
+    }
+
+    int TakeWorker(){ // A worker with a free slot (the one with the most), -1 if none, its slot is held until ReleaseWorker
+        std::lock_guard<std::mutex> lock(WorkerLock);
+        int best = -1;
+        for (size_t w = 0; w < Workers.size(); w++){
+            if (Workers[w].dead || Workers[w].busy >= Workers[w].slots) continue;
+            if (best < 0 || Workers[w].slots - Workers[w].busy > Workers[best].slots - Workers[best].busy) best = static_cast<int>(w);
+        }
+        if (best >= 0) Workers[best].busy++;
+        return best;
+    }
+
+    void ReleaseWorker(int w){
+        std::lock_guard<std::mutex> lock(WorkerLock);
+        Workers[w].busy--;
+    }
+
+    void DropWorker(int w, const std::string& why){ // Stop sending a worker compiles, they run here from now on
+        std::lock_guard<std::mutex> lock(WorkerLock);
+        if (Workers[w].dead) return;
+        Workers[w].dead = true;
+        std::lock_guard<std::mutex> outlock(OutputLock);
+        std::cout << "Worker " << Workers[w].address << " dropped (" << why << "), compiling locally instead" << std::endl;
+    }
+
+    std::vector<std::string> RemoteArgs(const Job& job){
+        /* The command compiling a job's preprocessed source (job.output + ".i"), the same wherever it runs
+                The job's own command without its depfile (preprocessing wrote it) and forced includes (already in the source)
+                GCC: preprocessed with `-fdirectives-only`, so macros are still expanded by the compile and columns in the
+                     debug info come out right, and the build directory rides along in the source for DW_AT_comp_dir
+                Clang: preprocessed with `-frewrite-includes`, compiled again as C / C++ with `-fdebug-compilation-dir`
+        */
+        std::vector<std::string> args;
+        bool Clang = std::find(job.preargv.begin(), job.preargv.end(), "-frewrite-includes") != job.preargv.end(); // A matrix mixes compilers
+        for (size_t k = 0; k < job.argv.size(); k++){
+            const std::string& arg = job.argv[k];
+            if (arg == "-MMD" || arg == "-MD") continue;
+            if (arg == "-MF" || arg == "-include" || arg == "-include-pch"){
+                k++;
+                continue;
+            }
+            if (arg != job.inputs[0]){
+                args.push_back(arg);
+                continue;
+            }
+            if (Clang){
+                args.insert(args.end(), {"-fdebug-compilation-dir=" + std::filesystem::current_path().string(), "-x", IsCXX ? "c++" : "c"});
+            } else {
+                args.insert(args.end(), {"-fdirectives-only", "-x", IsCXX ? "c++-cpp-output" : "cpp-output"});
+            }
+            args.push_back(job.output + ".i");
+        }
+        return args;
+    }
+
+    bool RemoteSafe(const std::vector<std::string>& CompArgs){
+        /* Whether compiling a target's preprocessed source gives the object compiling its source does, byte for byte
+                Without debug info it always does. With it, the preprocessing flag shows up in DW_AT_producer when the
+                compiler records its flags there (GCC by default, `-gno-record-gcc-switches` stops it), and `-g3` macro
+                info comes out different, those compiles stay here
+        */
+        bool Debug = false;
+        bool Record = !CompilerIsClang(); // Clang only does with -grecord-command-line
+        for (auto &arg : CompArgs){
+            if (arg == "-g3" || arg == "-ggdb3" || arg == "-fdebug-macro") return false;
+            if (arg == "-frecord-gcc-switches" || arg == "-frecord-command-line") return false; // Lists them in a section of its own
+            if (arg == "-g0") Debug = false;
+            else if (arg == "-g" || arg == "-g1" || arg == "-g2" || arg.rfind("-ggdb", 0) == 0 || arg.rfind("-gdwarf", 0) == 0) Debug = true;
+            else if (arg == "-grecord-gcc-switches" || arg == "-grecord-command-line") Record = true;
+            else if (arg == "-gno-record-gcc-switches" || arg == "-gno-record-command-line") Record = false;
+        }
+        return !(Debug && Record);
+    }
+
+    bool WorkerFlag(const std::string& arg){
+        /* Whether a worker passes a compile flag on, see ServeCompiles. Only flags that change how code is generated
+           or diagnosed, nothing that loads plugins, runs other programs, or reads or writes files of its own
+        */
+        static const char* Allowed[] = {"-O", "-W", "-D", "-U", "-f", "-m", "-g", "-std=", "--param=", "-I"};
+        static const char* Denied[] = {"-Wl,", "-Wa,", "-Wp,", "-fplugin", "-fpass-plugin", "-fprofile", "-fauto-profile",
+                                       "-fcs-profile", "-fcreate-profile", "-fdump", "-fopt-info", "-fsave-optimization-record",
+                                       "-fcallgraph-info", "-fstack-usage", "-ftest-coverage", "-fcoverage", "-fcrash-diagnostics",
+                                       "-ftime-trace", "-fproc-stat-report", "-fmodule", "-fprebuilt-module", "-fembed",
+                                       "-fsanitize-blacklist", "-fsanitize-ignorelist", "-fsanitize-coverage-", "-fxray-",
+                                       "-fdiagnostics-add-output", "-fdiagnostics-format", "-frecord"};
+        static const char* PathMaps[] = {"-fdebug-compilation-dir=", "-fdebug-prefix-map=", "-ffile-prefix-map=",
+                                         "-fmacro-prefix-map=", "-D", "-I"}; // Only strings, never opened
+        if (arg == "-c" || arg == "-w" || arg == "-pipe" || arg == "-pthread" || arg == "-pedantic" || arg == "-pedantic-errors") return true;
+        bool known = false;
+        for (auto prefix : Allowed) known = known || arg.rfind(prefix, 0) == 0;
+        for (auto prefix : Denied) known = known && arg.rfind(prefix, 0) != 0;
+        if (!known) return false;
+        for (auto prefix : PathMaps){
+            if (arg.rfind(prefix, 0) == 0) return true;
+        }
+        size_t eq = arg.find('=');
+        return eq == std::string::npos || arg.find_first_of("/\\", eq) == std::string::npos; // A path is something it would open
+    }
+
+    bool RemoteCompile(const Job& job, int w, bool preprocessed, CmdResult& result){
+        /* Compile a job on worker `w`, false if preprocessing failed so the normal compile reports why
+                Request:  "OBJW" version, compiler key, args, preprocessed source path + contents, object path
+                Reply:    kind (0 compiled, 1 won't take this job, 2 won't take any), exit status, output, object
+           A worker that can't be reached, breaks off or turns every job down is dropped, and the same command
+           then runs here on the same source, so where a compile ran never changes the object
+        */
+        std::string iname = job.output + ".i";
+        if (!preprocessed && RunCommand(job.preargv).status != 0) return false; // CacheFetch already did unless the cache is off
+        StoreReader source;
+        if (!ReadStore(iname.c_str(), source)) return false;
+        std::vector<std::string> args = RemoteArgs(job);
+        std::string request = "OBJW";
+        PutU32(request, 1);
+        PutString(request, CompilerKey(args[0]));
+        PutU32(request, static_cast<uint32_t>(args.size()));
+        for (auto &arg : args) PutString(request, arg);
+        PutString(request, iname);
+        PutString(request, source.data);
+        PutString(request, job.output);
+
+        std::string error, reply;
+        int fd = OpenSocket(Workers[w].address, false, error);
+        bool done = false;
+        if (fd >= 0){
+            #ifndef _WIN32
+            timeval limit{600, 0}; // A worker that hangs, or a machine that vanished, doesn't hold the build forever
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &limit, sizeof(limit));
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &limit, sizeof(limit));
+            if (SendAll(fd, request) && shutdown(fd, SHUT_WR) == 0 && ReceiveAll(fd, reply)){
+                StoreReader in;
+                in.data = std::move(reply);
+                uint32_t kind = 0, status = 0;
+                std::string object;
+                ReadU32(in, kind);
+                ReadU32(in, status);
+                ReadString(in, result.output);
+                ReadString(in, object);
+                if (!in.ok){
+                    error = "bad reply";
+                } else if (kind == 2){
+                    error = result.output;
+                } else if (kind == 0){ // Kind 1 turned down just this job, the worker stays
+                    result.status = static_cast<int>(status);
+                    std::ofstream out(job.output + ".tmp", std::ios::binary | std::ios::trunc);
+                    out.write(object.data(), object.size());
+                    out.close();
+                    std::error_code ec;
+                    if (status == 0 && out) std::filesystem::rename(job.output + ".tmp", job.output, ec);
+                    else std::filesystem::remove(job.output + ".tmp", ec);
+                    done = !ec && (status != 0 || out); // Couldn't write it here, compile here too
+                }
+            } else {
+                error = errno ? strerror(errno) : "connection closed";
+            }
+            close(fd);
+            #endif
+        }
+        if (!error.empty()) DropWorker(w, error);
+        if (done){
+            RemoteCompiles++;
+        } else {
+            RemoteFailovers++;
+            result = RunCommand(args);
+        }
+        std::error_code ec;
+        std::filesystem::remove(iname, ec);
+        return true;
+    }
+
+    void ServeCompiles(const std::string& address, int slots, std::vector<std::string> compilers){
+        /* `--serve=address`, be a compile worker (see RemoteCompile) until killed, running up to `slots` compiles at once
+                Only `compilers` (`--compiler=`, or else the worker's CC and CXX) are run, and only when the client has the
+                same one (same `--version`), with nothing but the preprocessed source, its object and flags WorkerFlag allows
+                Each request's source and object live in a temporary directory of their own, the paths in the command
+                are moved into it
+        */
+        #ifndef _WIN32
+        if (compilers.empty()){
+            for (const char* env : {getenv("CC"), getenv("CXX")}){
+                std::vector<std::string> words = env ? SplitBySpace(StripBadChars(env)) : std::vector<std::string>();
+                if (!words.empty()) compilers.push_back(words.back()); // "ccache gcc" serves gcc
+            }
+        }
+        std::set<std::filesystem::path> Compilers; // Resolved, so "gcc" and "/usr/bin/gcc" are the same one
+        for (auto &compiler : compilers){
+            std::error_code ec;
+            std::string found = FindProgram(compiler);
+            if (found.empty()){
+                std::cerr << "Can't serve " << compiler << ", it isn't installed" << std::endl;
+                exit(1);
+            }
+            Compilers.insert(std::filesystem::canonical(found, ec));
+            std::cout << "Serving compiles with " << found << std::endl;
+        }
+        if (Compilers.empty()){
+            std::cerr << "Nothing to compile with, give --compiler= or set CC / CXX" << std::endl;
+            exit(1);
+        }
+        std::string error;
+        int listener = OpenSocket(address, true, error);
+        if (listener < 0){
+            std::cerr << "Can't listen on " << address << ": " << error << std::endl;
+            exit(1);
+        }
+        std::cout << "Serving compiles on " << address << " with " << slots << " slot(s)" << std::endl;
+        std::mutex SlotLock;
+        std::condition_variable SlotFree;
+        int Free = slots;
+        std::atomic<size_t> Requests{0};
+        auto serve = [&](int fd){
+            std::string reply;
+            StoreReader in;
+            char magic[4] = {};
+            uint32_t version = 0, nargs = 0;
+            std::string key, iname, source, oname;
+            std::vector<std::string> args;
+            ReceiveAll(fd, in.data);
+            ReadBytes(in, magic, sizeof(magic));
+            ReadU32(in, version);
+            ReadString(in, key);
+            ReadU32(in, nargs);
+            for (uint32_t k = 0; in.ok && k < nargs; k++){
+                args.emplace_back();
+                ReadString(in, args.back());
+            }
+            ReadString(in, iname);
+            ReadString(in, source);
+            ReadString(in, oname);
+            auto refuse = [&](uint32_t kind, const std::string& why){
+                PutU32(reply, kind);
+                PutU32(reply, 0);
+                PutString(reply, why);
+                PutString(reply, "");
+            };
+            auto unsafe = [](const std::string& path){ return path.empty() || path[0] == '/' || path.find("..") != std::string::npos; };
+            std::string program = args.empty() ? "" : FindProgram(args[0]);
+            std::error_code ec;
+            bool served = !program.empty() && Compilers.count(std::filesystem::canonical(program, ec));
+            std::string bad; // First argument that isn't the source, the object or an allowed flag
+            bool compiles = false, reads = false, writes = false; // -c, the source once, -o and the object once
+            for (size_t k = 1; served && bad.empty() && k < args.size(); k++){
+                const std::string& arg = args[k];
+                std::string next = k + 1 < args.size() ? args[k + 1] : "";
+                if (arg == iname && !reads){
+                    reads = true;
+                } else if (arg == "-o" && next == oname && !writes){
+                    writes = true;
+                    k++;
+                } else if (arg == "-x" && (next == "c" || next == "c++" || next == "cpp-output" || next == "c++-cpp-output")){
+                    k++;
+                } else if (arg == "-c"){
+                    compiles = true;
+                } else if (!WorkerFlag(arg)){
+                    bad = arg;
+                }
+            }
+            if (!in.ok || std::string(magic, sizeof(magic)) != "OBJW" || version != 1 || args.empty()){
+                refuse(2, "not a compile request this worker understands");
+            } else if (!served){ // Only this compiler's jobs, the client may bring others the worker does run
+                refuse(1, args[0] + " isn't a compiler this worker runs");
+            } else if (CompilerKey(program) != key){
+                refuse(1, "its " + args[0] + " isn't the same compiler");
+            } else if (unsafe(iname) || unsafe(oname)){
+                refuse(1, "path outside the build");
+            } else if (!bad.empty() || !compiles || !reads || !writes){
+                refuse(1, bad.empty() ? "not a compile of one preprocessed source" : "won't pass on " + bad);
+            } else {
+                args[0] = program;
+                std::filesystem::path Dir = std::filesystem::temp_directory_path() /
+                                            ("objworker-" + std::to_string(getpid()) + "-" + std::to_string(Requests++));
+                std::filesystem::path In = Dir / iname, Out = Dir / oname;
+                std::filesystem::create_directories(In.parent_path(), ec);
+                std::filesystem::create_directories(Out.parent_path(), ec);
+                std::ofstream(In, std::ios::binary).write(source.data(), source.size());
+                for (auto &arg : args){
+                    if (arg == iname) arg = In.string();
+                    else if (arg == oname) arg = Out.string();
+                }
+                CmdResult result;
+                {
+                    std::unique_lock<std::mutex> lock(SlotLock);
+                    SlotFree.wait(lock, [&](){ return Free > 0; });
+                    Free--;
+                }
+                result = RunCommand(args);
+                {
+                    std::lock_guard<std::mutex> lock(SlotLock);
+                    Free++;
+                }
+                SlotFree.notify_one();
+                StoreReader object;
+                if (result.status == 0) ReadStore(Out.string().c_str(), object);
+                PutU32(reply, 0);
+                PutU32(reply, static_cast<uint32_t>(result.status));
+                PutString(reply, result.output);
+                PutString(reply, object.data);
+                std::filesystem::remove_all(Dir, ec);
+                std::lock_guard<std::mutex> lock(OutputLock);
+                std::cout << (result.status == 0 ? "COMPILED: " : "FAILED: ") << iname << std::endl;
+            }
+            SendAll(fd, reply);
+            close(fd);
+        };
+        for (;;){
+            int fd = CloexecAccept(listener);
+            if (fd < 0) continue;
+            timeval limit{600, 0}; // A client that stops sending mid request
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &limit, sizeof(limit));
+            std::thread(serve, fd).detach();
+        }
+        #else
+        (void)address;
+        (void)slots;
+        std::cerr << "--serve isn't supported on Windows" << std::endl;
+        exit(1);
+        #endif
+    }
+
+    bool ArchiveUpdate(const Job& job, std::vector<std::string>& Partial){
+        /* For a static library in "thin" or "incremental" mode, the `ar` command that replaces only the objects newer
+           than when the library was last built (Partial), false when it has to be written from scratch instead:
+                "full" mode, no library or build log entry yet, a different member list or `ar` (the command hash changed,
+                so no member is left behind that's gone from the target) or, in a regular archive, two objects with the same
+                name (`ar` would replace the wrong one)
+        */
+        if (ArchiveMode == "full" || IsMSVC) return false;
+        uint64_t cmdhash = 0;
+        int64_t stamp = 0, otime = 0;
+        {
+            std::lock_guard<std::mutex> lock(LogLock);
+            auto entry = BuildLog.find(job.output);
+            if (entry == BuildLog.end()) return false;
+            cmdhash = entry->second.cmdhash;
+            stamp = entry->second.inputstamp;
+        }
+        if (cmdhash != CommandHash(job.argv) || !FileTime(job.output, otime)) return false;
+        if (ArchiveMode != "thin"){
+            std::unordered_set<std::string> Names;
+            for (auto &obj : job.inputs){
+                if (!Names.insert(obj.substr(obj.find_last_of(Windows ? "/\\" : "/") + 1)).second) return false;
+            }
+        }
+        Partial.assign(job.argv.begin(), job.argv.begin() + 3); // ar, flags, library
+        for (auto &obj : job.inputs){
+            int64_t mtime;
+            if (!FileTime(obj, mtime) || mtime > stamp) Partial.push_back(obj);
+        }
+        return Partial.size() > 3; // Nothing newer means a time moved backwards, write it all again
+    }
+
+    bool RunJob(const Job& job, size_t index, std::atomic<size_t>& ran, size_t worker){ // Run one job unless RunJobs found it up to date, false if it failed
+        if (!JobDirty[index]) return true;
+        ran++;
+        double Start = SinceStart();
+        std::vector<std::string> Partial; // What's run instead of job.argv for a library updated in place, see ArchiveUpdate
+        if (job.kind == ArchiveJob && !ArchiveUpdate(job, Partial)){
+            std::error_code ec;
+            std::filesystem::remove(job.output, ec); // `ar r` keeps members a new command no longer lists
+        }
+        const std::vector<std::string>& Command = Partial.empty() ? job.argv : Partial;
+        CmdResult result;
+        int remote = index < JobWorker.size() ? JobWorker[index] : -1; // Worker RunJobs gave it to
+        bool cached = !CacheDir.empty() && !job.preargv.empty() && CacheFetch(job, result, remote >= 0);
+        if (!cached){
+            if (!CacheDir.empty() && !job.preargv.empty()){
+                // The object may be hardlinked into the cache, make the compiler write a new file
+                std::error_code ec;
+                std::filesystem::remove(job.output, ec);
+            }
+            if (remote < 0 || !RemoteCompile(job, remote, !CacheDir.empty(), result)) result = RunCommand(Command);
+            if (result.status == 0 && !job.preargv.empty() && !CacheDir.empty()) CacheStore(job, result);
+        }
+        {
+            std::lock_guard<std::mutex> lock(TraceLock);
+            Trace.push_back({job.banner, job.kind, Start, SinceStart() - Start, result.usertime, result.systime, result.maxrss, worker});
+            if (index < JobCpu.size()) JobCpu[index] = result.usertime + result.systime;
+        }
+        double Wall = SinceStart() - Start;
+        int64_t otime;
+        bool written = FileTime(job.output, otime, true); // The job (re)wrote its output, what waits on it must see the new time
+        if (result.status == 0 && job.kind == PackageJob && !written){ // dwp exits 0 when it found no .dwo files to package
+            result.status = 1;
+            result.output += job.output + " wasn't written, no .dwo files to package\n";
+        }
+        if (job.deps) RecordDeps(job, result);
+        if (PgoPhase == "use" && job.kind == CompileJob) CountUnprofiled(result.output);
+        if (result.status == 0){
+            std::vector<std::string> inputs;
+            JobInputs(job, inputs); // After RecordDeps, so headers the compile just reported are included
+            int64_t stamp;
+            InputStamp(inputs, stamp);
+            std::lock_guard<std::mutex> lock(LogLock);
+            LogEntry &entry = BuildLog[job.output];
+            entry.cmdhash = CommandHash(job.argv);
+            entry.inputstamp = stamp;
+            if (!cached && result.maxrss > 0) entry.maxrss = static_cast<uint64_t>(result.maxrss);
+            if (!cached) entry.duration = static_cast<uint64_t>(Wall * 1e6);
+        } else { // Never trust whatever a failed command left behind, but remember what it took (an OOM kill included)
+            FailedJobs++;
+            std::lock_guard<std::mutex> lock(LogLock);
+            LogEntry &entry = BuildLog[job.output];
+            entry.cmdhash = 0;
+            if (result.maxrss > 0) entry.maxrss = static_cast<uint64_t>(result.maxrss);
+        }
+        std::lock_guard<std::mutex> lock(OutputLock);
+        std::cout << Progress(index) << job.banner << (cached ? " (cached)" : "");
+        if (!Partial.empty()) std::cout << " (" << Partial.size() - 3 << " of " << job.inputs.size() << " member(s) replaced)";
+        std::cout << std::endl << result.output;
+        if (result.status != 0){
+            std::cout << "FAILED (exit " << result.status << "): " << ShowCommand(Command) << std::endl;
+        }
+        std::cout << std::flush;
+        return result.status == 0;
+    }
+
+    void JobMemory(const std::vector<Job>& jobs, std::vector<uintmax_t>& Need){
+        /* How much memory each job is expected to take, in bytes
+                The peak the build log recorded for its output the last time it ran, plus 10%
+                Without one, compiles are taken to need the average recorded compile (at least 256 MiB),
+                links 512 MiB (2 GiB with LTO, whose optimizer runs in the link), dwp 256 MiB and archives 64 MiB
+        */
+        std::lock_guard<std::mutex> lock(LogLock);
+        uintmax_t Known = 0, Count = 0;
+        for (auto &job : jobs){
+            auto entry = BuildLog.find(job.output);
+            if (job.kind == CompileJob && entry != BuildLog.end() && entry->second.maxrss > 0){
+                Known += entry->second.maxrss * 1024;
+                Count++;
+            }
+        }
+        const uintmax_t MiB = 1024 * 1024;
+        uintmax_t Compile = (std::max)(Count ? Known / Count : 0, 256 * MiB);
+        for (size_t i = 0; i < jobs.size(); i++){
+            auto entry = BuildLog.find(jobs[i].output);
+            if (entry != BuildLog.end() && entry->second.maxrss > 0) Need[i] = entry->second.maxrss * 1024 / 10 * 11;
+            else if (jobs[i].kind == CompileJob) Need[i] = Compile;
+            else if (jobs[i].kind == LinkJob) Need[i] = (LtoMode.empty() ? 512 : 2048) * MiB;
+            else if (jobs[i].kind == PackageJob) Need[i] = 256 * MiB;
+            else Need[i] = 64 * MiB;
+        }
+    }
+
+    void JobDurations(const std::vector<Job>& jobs, std::vector<double>& Estimate){
+        /* How long each job that has to run is expected to take, in seconds
+                The time the build log recorded for its output the last time it ran
+                Without one, a compile is taken to cost what the recorded compiles cost per byte of source
+                (10 us a byte if none are), everything else the average recorded one of its kind (1 s a link, 0.1 s an archive, 0.5 s a dwp)
+        */
+        std::lock_guard<std::mutex> lock(LogLock);
+        std::vector<uintmax_t> Size(jobs.size(), 0);
+        double KnownTime = 0, KnownBytes = 0, KindTime[4] = {0, 0, 0, 0}, KindCount[4] = {0, 0, 0, 0};
+        for (size_t i = 0; i < jobs.size(); i++){
+            if (!JobDirty[i]) continue;
+            auto entry = BuildLog.find(jobs[i].output);
+            double took = entry != BuildLog.end() ? entry->second.duration / 1e6 : 0;
+            if (jobs[i].kind == CompileJob && !jobs[i].inputs.empty()){ // Only what has to run is stat'ed, a no-op build pays nothing
+                std::error_code ec;
+                Size[i] = std::filesystem::file_size(jobs[i].inputs[0], ec);
+                if (ec) Size[i] = 0;
+                if (took > 0 && Size[i] > 0){
+                    KnownTime += took;
+                    KnownBytes += static_cast<double>(Size[i]);
+                }
+            }
+            if (took > 0){
+                KindTime[jobs[i].kind] += took;
+                KindCount[jobs[i].kind]++;
+            }
+        }
+        double PerByte = KnownBytes > 0 ? KnownTime / KnownBytes : 10e-6;
+        double Default[4] = {0.25, 1.0, 0.1, 0.5};
+        for (int kind = 0; kind < 4; kind++){
+            if (KindCount[kind] > 0) Default[kind] = KindTime[kind] / KindCount[kind];
+        }
+        for (size_t i = 0; i < jobs.size(); i++){
+            if (!JobDirty[i]) continue;
+            auto entry = BuildLog.find(jobs[i].output);
+            if (entry != BuildLog.end() && entry->second.duration > 0) Estimate[i] = entry->second.duration / 1e6;
+            else if (jobs[i].kind == CompileJob && Size[i] > 0) Estimate[i] = (std::max)(PerByte * static_cast<double>(Size[i]), 0.01);
+            else Estimate[i] = Default[jobs[i].kind];
+        }
+    }
+
+    std::string ShowSeconds(double seconds){ // "42s", "3m07s", "1h05m"
+        long total = static_cast<long>(seconds + 0.5);
+        char text[32];
+        if (total < 60) snprintf(text, sizeof(text), "%lds", total);
+        else if (total < 3600) snprintf(text, sizeof(text), "%ldm%02lds", total / 60, total % 60);
+        else snprintf(text, sizeof(text), "%ldh%02ldm", total / 3600, total / 60 % 60);
+        return text;
+    }
+
+    void Started(size_t index){ // A job that has to run is starting, for the progress line
+        std::lock_guard<std::mutex> lock(ProgressLock);
+        auto found = PathsLeft.find(JobPath[index]);
+        if (found != PathsLeft.end()) PathsLeft.erase(found);
+        WorkLeft = (std::max)(WorkLeft - JobEstimate[index], 0.0);
+        RunningSince[index] = SinceStart();
+    }
+
+    std::string Progress(size_t index){ /* Count a job that had to run as done and give the progress line's prefix for it
+                                                "[done/to run, ~time left] ", the time left being the longer of the expected work
+                                                still to do spread over the pool and the longest chain still ahead, what's
+                                                running now counted for what it has left of its estimate
+                                         */
+        std::lock_guard<std::mutex> lock(ProgressLock);
+        ProgressDone++;
+        RunningSince.erase(index);
+        double now = SinceStart(), work = WorkLeft, path = PathsLeft.empty() ? 0.0 : *PathsLeft.rbegin();
+        for (auto &run : RunningSince){
+            double spent = (std::min)(now - run.second, JobEstimate[run.first]);
+            work += JobEstimate[run.first] - spent;
+            path = (std::max)(path, JobPath[run.first] - spent);
+        }
+        double left = (std::max)(work / (std::max)(Jobs, 1), path);
+        return "[" + std::to_string(ProgressDone) + "/" + std::to_string(ProgressTotal) + ", ~" + ShowSeconds(left) + " left] ";
+    }
+
+    uintmax_t AvailableMemory(){ /* Memory a build may use when nothing set a budget, 0 when it can't be told (no limit)
+                                        Linux: MemAvailable from /proc/meminfo, or what's left under the cgroup's limit if that's less
+                                 */
+        #ifdef __linux__
+        uintmax_t avail = 0;
+        std::ifstream meminfo("/proc/meminfo");
+        std::string key;
+        uintmax_t value = 0;
+        while (meminfo >> key >> value){
+            if (key == "MemAvailable:"){
+                avail = value * 1024;
+                break;
+            }
+            meminfo.ignore(256, '\n');
+        }
+        auto readNumber = [](const std::string& path, uintmax_t& out){
+            std::ifstream in(path);
+            std::string text;
+            if (!(in >> text) || text.find_first_not_of("0123456789") != std::string::npos) return false; // "max" is no limit
+            out = strtoull(text.c_str(), nullptr, 10);
+            return true;
+        };
+        std::ifstream cgroups("/proc/self/cgroup");
+        std::string line;
+        while (std::getline(cgroups, line)){ // "0::/path" for cgroup v2, "4:memory:/path" for v1
+            size_t first = line.find(':'), second = line.find(':', first + 1);
+            if (first == std::string::npos || second == std::string::npos) continue;
+            std::string controllers = line.substr(first + 1, second - first - 1), path = line.substr(second + 1);
+            uintmax_t limit = 0, used = 0;
+            bool found = false;
+            if (controllers.empty()){
+                found = readNumber("/sys/fs/cgroup" + path + "/memory.max", limit) && readNumber("/sys/fs/cgroup" + path + "/memory.current", used);
+            } else if (controllers == "memory"){
+                found = (readNumber("/sys/fs/cgroup/memory" + path + "/memory.limit_in_bytes", limit) &&
+                         readNumber("/sys/fs/cgroup/memory" + path + "/memory.usage_in_bytes", used)) ||
+                        (readNumber("/sys/fs/cgroup/memory/memory.limit_in_bytes", limit) &&
+                         readNumber("/sys/fs/cgroup/memory/memory.usage_in_bytes", used)); // Inside a container the cgroup is the root
+            }
+            if (found && limit > used && limit < (1ULL << 60) && (avail == 0 || limit - used < avail)) avail = limit - used;
+        }
+        return avail;
+        #else
+        return 0;
+        #endif
+    }
+
+    size_t RunJobs(const std::vector<Job>& jobs){ /* Run every job as one task graph on at most `Jobs` threads
+                                                          A job waits for the jobs producing its inputs (a link for its objects and
+                                                          the libraries it links, a compile for its precompiled header) and nothing else,
+                                                          so one target's links overlap with another's compiles
+                                                          Of the jobs ready to start, the one with the longest chain of expected time still
+                                                          behind it (see JobDurations) starts first, so a slow compile a big link waits on
+                                                          isn't left for the end
+                                                     Returns how many jobs were not up to date and had to run
+                                                  */
+        std::unordered_map<std::string, size_t> Producers;
+        for (size_t i = 0; i < jobs.size(); i++) Producers[jobs[i].output] = i;
+        std::vector<std::vector<size_t>> Dependents(jobs.size());
+        std::vector<size_t> Waiting(jobs.size(), 0);
+        for (size_t i = 0; i < jobs.size(); i++){
+            for (auto &in : jobs[i].inputs){
+                auto found = Producers.find(in);
+                if (found == Producers.end() || found->second == i) continue;
+                Dependents[found->second].push_back(i);
+                Waiting[i]++;
+            }
+        }
+
+        // Which jobs have to run is known up front: the ones not up to date and everything waiting on one of them
+        JobDirty.assign(jobs.size(), 0);
+        JobFailed.assign(jobs.size(), 0);
+        JobCpu.assign(jobs.size(), 0);
+        JobEnd.assign(jobs.size(), 0);
+        std::vector<size_t> Order; // Producers before what waits on them
+        std::vector<size_t> Left = Waiting;
+        Order.reserve(jobs.size());
+        for (size_t i = 0; i < jobs.size(); i++){
+            if (Left[i] == 0) Order.push_back(i);
+        }
+        for (size_t o = 0; o < Order.size(); o++){
+            size_t i = Order[o];
+            if (!JobDirty[i] && !IsUpToDate(jobs[i])) JobDirty[i] = 1;
+            for (auto dep : Dependents[i]){
+                if (JobDirty[i]) JobDirty[dep] = 1;
+                if (--Left[dep] == 0) Order.push_back(dep);
+            }
+        }
+        // A no-op build is decided here, every check was a file table lookup, so skip the estimates and the pool
+        if (Order.size() == jobs.size() && std::find(JobDirty.begin(), JobDirty.end(), 1) == JobDirty.end()) return 0;
+        // The longest chain of expected time from each job to the end of the build, those with the longest go first
+        JobEstimate.assign(jobs.size(), 0);
+        JobPath.assign(jobs.size(), 0);
+        JobDurations(jobs, JobEstimate);
+        for (size_t o = Order.size(); o-- > 0;){
+            size_t i = Order[o];
+            double after = 0;
+            for (auto dep : Dependents[i]) after = (std::max)(after, JobPath[dep]);
+            JobPath[i] = JobEstimate[i] + after;
+        }
+        ProgressDone = ProgressTotal = 0;
+        WorkLeft = 0;
+        PathsLeft.clear();
+        RunningSince.clear();
+        for (size_t i = 0; i < jobs.size(); i++){
+            if (!JobDirty[i]) continue;
+            ProgressTotal++;
+            WorkLeft += JobEstimate[i];
+            PathsLeft.insert(JobPath[i]);
+        }
+        auto before = [&](size_t a, size_t b){ return JobPath[a] > JobPath[b] || (JobPath[a] == JobPath[b] && a < b); };
+        std::deque<size_t> Ready; // Kept in `before` order
+        for (size_t i = 0; i < jobs.size(); i++){
+            if (Waiting[i] == 0) Ready.push_back(i);
+        }
+        std::sort(Ready.begin(), Ready.end(), before);
+
+        std::mutex GraphLock;
+        std::condition_variable Wake;
+        std::vector<bool> Broken(jobs.size(), false); // Something it needs failed
+        size_t Finished = 0, Running = 0;
+        std::atomic<size_t> ran(0);
+
+        // Jobs are admitted against the memory budget and links against their own slots, see JobMemory
+        std::vector<uintmax_t> Need(jobs.size(), 0);
+        if (MemBudget > 0) JobMemory(jobs, Need);
+        // and a link told to use more than one thread (see LinkerFlags) takes that many of the pool's slots
+        size_t LinkSlots = LinkSlotCount();
+        uintmax_t MemInUse = 0;
+        size_t RunningLinks = 0, CoresInUse = 0;
+        auto cores = [&](size_t i){ return jobs[i].kind == LinkJob ? static_cast<size_t>(LinkThreads) : 1; };
+        // A compile given to a worker (see RemoteCompile) takes one of its slots instead, and nothing here
+        JobWorker.assign(jobs.size(), -1);
+        int Picked = -1; // Worker slot `pick` took for the job it chose, -1 when it runs here
+        auto pick = [&](){ // Position in Ready of the job with the longest path that may start now, Ready.size() if none
+            int w = Workers.empty() ? -1 : TakeWorker();
+            bool held = false; // Something waits for slots here, only a compile going to a worker may pass it
+            Picked = -1;
+            for (size_t r = 0; r < Ready.size(); r++){
+                size_t i = Ready[r];
+                if (w >= 0 && jobs[i].remote && JobDirty[i] && !Broken[i]){
+                    Picked = w;
+                    return r;
+                }
+                if (held) continue;
+                if (Running == 0){ // Something always runs, even a job bigger than the whole budget
+                    if (w >= 0) ReleaseWorker(w);
+                    return r;
+                }
+                if (jobs[i].kind == LinkJob && RunningLinks >= LinkSlots) continue;
+                if (CoresInUse + cores(i) > static_cast<size_t>(Jobs)){ // Hold the slots for it, or compiles take them forever
+                    if (w < 0) return Ready.size();
+                    held = true;
+                    continue;
+                }
+                if (MemBudget > 0 && MemInUse + Need[i] > MemBudget) continue;
+                if (w >= 0) ReleaseWorker(w);
+                return r;
+            }
+            if (w >= 0) ReleaseWorker(w);
+            return Ready.size();
+        };
+        auto worker = [&](size_t WorkerId){
+            std::unique_lock<std::mutex> lock(GraphLock);
+            for (;;){
+                size_t r = 0;
+                Wake.wait(lock, [&](){ r = pick(); return r < Ready.size() || Running == 0; });
+                if (Ready.empty()) break; // Everything is done (or the rest can never become ready)
+                size_t i = Ready[r];
+                Ready.erase(Ready.begin() + r);
+                Running++;
+                JobWorker[i] = Picked;
+                if (Picked < 0){
+                    MemInUse += Need[i];
+                    CoresInUse += cores(i);
+                }
+                if (jobs[i].kind == LinkJob) RunningLinks++;
+                bool ok = false;
+                lock.unlock();
+                if (JobDirty[i]) Started(i);
+                if (!Broken[i]){
+                    ok = RunJob(jobs[i], i, ran, WorkerId);
+                } else {
+                    std::lock_guard<std::mutex> outlock(OutputLock);
+                    std::cout << Progress(i) << "SKIPPED: " << jobs[i].banner << " (needs a file that failed to build)" << std::endl;
+                }
+                if (JobWorker[i] >= 0) ReleaseWorker(JobWorker[i]);
+                lock.lock();
+                if (!ok) JobFailed[i] = 1;
+                JobEnd[i] = SinceStart();
+                Running--;
+                if (JobWorker[i] < 0){
+                    MemInUse -= Need[i];
+                    CoresInUse -= cores(i);
+                }
+                if (jobs[i].kind == LinkJob) RunningLinks--;
+                Finished++;
+                for (auto dep : Dependents[i]){
+                    if (!ok) Broken[dep] = true;
+                    if (--Waiting[dep] == 0) Ready.insert(std::upper_bound(Ready.begin(), Ready.end(), dep, before), dep);
+                }
+                Wake.notify_all();
+            }
+        };
+        size_t nthreads = static_cast<size_t>(Jobs);
+        for (auto &remote : Workers) nthreads += static_cast<size_t>(remote.slots); // Threads waiting on workers use no CPU here
+        if (nthreads > jobs.size()) nthreads = jobs.size();
+        std::vector<std::thread> threads;
+        for (size_t t = 1; t < nthreads; t++){ // The calling thread is the first worker
+            threads.emplace_back(worker, t);
+        }
+        worker(0);
+        for (auto &th : threads){
+            th.join();
+        }
+        if (Finished != jobs.size()){ // Only a cycle leaves jobs waiting forever
+            std::cerr << "Dependency cycle between targets, " << jobs.size() - Finished << " job(s) never ran" << std::endl;
+            FailedJobs++;
+        }
+        return ran;
+    }
+
+    std::string JsonString(const std::string& str){ // Quote and escape a string for JSON
+        std::string out = "\"";
+        for (char ch : str){
+            if (ch == '"' || ch == '\\') out += '\\';
+            if (static_cast<unsigned char>(ch) >= 0x20) out += ch;
+        }
+        return out + "\"";
+    }
+
+    void WriteTrace(){ /* Write every command of this build to TraceFile in Chrome's trace event format
+                                (load it in chrome://tracing or ui.perfetto.dev), one track per job pool thread
+                          Then print the slowest compiles and links
+                       */
+        const char* Kinds[] = {"compile", "link", "archive", "package"};
+        std::ofstream out(TraceFile, std::ios::trunc);
+        out << "{\"traceEvents\":[" << std::endl;
+        for (size_t i = 0; i < Trace.size(); i++){
+            auto &ev = Trace[i];
+            out << "{\"name\":" << JsonString(ev.name) << ",\"cat\":\"" << Kinds[ev.kind] << "\",\"ph\":\"X\""
+                << ",\"ts\":" << static_cast<long long>(ev.start * 1e6) << ",\"dur\":" << static_cast<long long>(ev.wall * 1e6)
+                << ",\"pid\":1,\"tid\":" << ev.worker
+                << ",\"args\":{\"user_ms\":" << static_cast<long long>(ev.usertime * 1e3)
+                << ",\"sys_ms\":" << static_cast<long long>(ev.systime * 1e3) << ",\"maxrss_kb\":" << ev.maxrss << "}}"
+                << (i + 1 < Trace.size() ? "," : "") << std::endl;
+        }
+        out << "],\"displayTimeUnit\":\"ms\"}" << std::endl;
+        out.close();
+        std::cout << "Wrote trace of " << Trace.size() << " command(s) to " << TraceFile << std::endl;
+
+        std::vector<TraceEvent> Sorted = Trace;
+        std::sort(Sorted.begin(), Sorted.end(), [](const TraceEvent& a, const TraceEvent& b){ return a.wall > b.wall; });
+        for (int links = 0; links < 2; links++){
+            std::cout << (links ? "Slowest links:" : "Slowest compiles:") << std::endl;
+            int shown = 0;
+            for (auto &ev : Sorted){
+                if ((ev.kind != CompileJob) != (links == 1) || shown == 5) continue;
+                std::cout << "  " << std::fixed << std::setprecision(2) << ev.wall << "s wall, " << ev.usertime + ev.systime
+                          << "s cpu, " << ev.maxrss / 1024 << " MiB  " << ev.name << std::endl;
+                shown++;
+            }
+        }
+        std::cout.unsetf(std::ios::fixed);
+    }
+
+    void PrintStats(size_t NJobs, size_t Ran){ // `--stats`, where the time of this run went
+        auto Ms = [](std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to){
+            return std::chrono::duration<double, std::milli>(to - from).count();
+        };
+        auto Now = std::chrono::steady_clock::now();
+        std::cout << std::fixed << std::setprecision(2)
+                  << "Stats: " << Ms(ProcessStart, Now) << " ms total, " << Ms(ProcessStart, BuildStart) << " ms configuring, "
+                  << ScanTime * 1e3 << " ms scanning, " << Ms(BuildStart, Now) - ScanTime * 1e3 << " ms building" << std::endl
+                  << "Stats: " << StatTable.size() << " file(s) in the file table, " << StatCalls << " stat call(s), "
+                  << DirOpens << " directory open(s)" << std::endl;
+        if (!SourceGlobs.empty()){
+            std::cout << "Stats: " << DirIndex.size() << " source directories indexed, " << DirsListed << " listed again" << std::endl;
+        }
+        std::cout << "Stats: " << NJobs << " job(s), " << UpToDateChecks << " up to date check(s), " << Ran << " ran" << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+    }
+
+    bool CompilerIsClang(){ // Ask the compiler once, Clang and GCC want different precompiled header flags
+        if (ClangState < 0){
+            std::vector<std::string> VersionArgs = {"--version"};
+            InsertCMD(VersionArgs);
+            ClangState = RunCommand(VersionArgs).output.find("clang") != std::string::npos;
+        }
+        return ClangState == 1;
+    }
+
+    void PrecompileHeader(const std::string& TargetName, const std::string& Header, const std::vector<std::string>& CompArgs,
+                          std::vector<std::string> &UseArgs, std::vector<std::string> &PreUseArgs, std::string &PchOut,
+                          std::vector<std::string> &Objs, std::vector<Job> &CompileJobs, std::unordered_set<std::string> &QueuedObjs){
+        /* Queue the precompiled header for a target, built once per target and set of flags
+                GCC:   `-x c++-header` -> pch/<target>.<tag>/<header>.gch, found by `-include pch/<target>.<tag>/<header>`
+                Clang: `-x c++-header` -> pch/<target>.<tag>/<header>.pch, used with `-include-pch`
+                MSVC:  a generated .cpp compiled with `/Yc`, every TU gets `/Yu` + `/FI`, and the .obj it makes is linked in
+           UseArgs are added to every compile of the target, PreUseArgs replace them when only preprocessing
+        */
+        std::string Src = Header;
+        if (Windows) Src.insert(0, "..\\");
+        else Src.insert(0, "../");
+        std::filesystem::path Dir = std::filesystem::path(TreeDir + "pch") / (TargetName + "." + FlagsTag(CompArgs));
+        std::filesystem::path Name = std::filesystem::path(Header).filename();
+        std::filesystem::create_directories(Dir);
+        std::vector<std::string> PchArgs = CompArgs;
+        if (!IsMSVC){
+            bool Clang = CompilerIsClang();
+            PchOut = (Dir / Name).string() + (Clang ? ".pch" : ".gch");
+            PchArgs.insert(PchArgs.end(), {"-x", IsCXX ? "c++-header" : "c-header", "-MMD", "-MF", PchOut + ".d", Src, "-o", PchOut});
+            if (Clang) UseArgs = {"-include-pch", PchOut};
+            else UseArgs = {"-Winvalid-pch", "-include", (Dir / Name).string()};
+            PreUseArgs = {"-include", Src};
+        } else {
+            std::string Stub = (Dir / Name).string() + ".cpp";
+            std::string StubObj = (Dir / Name).string() + ".obj";
+            PchOut = (Dir / Name).string() + ".pch";
+            if (!std::filesystem::exists(Stub)){
+                std::ofstream(Stub) << "#include \"" << Src << "\"" << std::endl;
+            }
+            if (IsCXX) PchArgs.push_back("/EHsc");
+            PchArgs.insert(PchArgs.end(), {"/showIncludes", "/c", Stub, "/Yc" + Src, "/Fp" + PchOut, "/Fo:" + StubObj});
+            UseArgs = {"/Yu" + Src, "/FI" + Src, "/Fp" + PchOut};
+            Objs.push_back(StubObj);
+        }
+        if (QueuedObjs.insert(PchOut).second){ // Queued once, even if a library and an executable share a name
+            CompileJobs.push_back({"PRECOMPILE: " + Src, PchArgs, PchOut, {Src}, true});
+        }
+    }
+
+    void LtoFlags(std::vector<std::string>& Compile, std::vector<std::string>& Link){
+        /* What `EnableLTO` adds to every compile and link
+                GCC:   `-flto`, the link runs its partitions on the job pool's threads with `-flto=<jobs>`,
+                       GCC has no ThinLTO, its default partitioning already splits the link, so "thin" is the same as "full"
+                Clang: `-flto` or `-flto=thin`, ThinLTO backends run on `-flto-jobs=<jobs>` threads and reuse LtoCache
+                MSVC:  `/GL` and `/LTCG`, "thin" links with `/LTCG:INCREMENTAL`
+           Only Clang's ThinLTO has a cache, a LtoCache anything else would ignore gets a warning
+        */
+        if (LtoMode.empty()) return;
+        std::string J = std::to_string(Jobs);
+        bool Clang = !IsMSVC && CompilerIsClang();
+        if (!LtoCache.empty() && !(Clang && LtoMode == "thin")){
+            std::cout << "Warning: the LTO cache " << LtoCache << " is only used by Clang's ThinLTO, ignoring it" << std::endl;
+        }
+        if (IsMSVC){
+            Compile = {"/GL"};
+            Link = {LtoMode == "thin" ? "/LTCG:INCREMENTAL" : "/LTCG"};
+        } else if (Clang){
+            Compile = {LtoMode == "thin" ? "-flto=thin" : "-flto"};
+            Link = Compile;
+            if (LtoMode == "thin"){
+                Link.push_back("-flto-jobs=" + J);
+                if (!LtoCache.empty() && Apple) Link.push_back("-Wl,-cache_path_lto," + LtoCache);
+                else if (!LtoCache.empty() && Linker() == "lld") Link.push_back("-Wl,--thinlto-cache-dir=" + LtoCache);
+                else if (!LtoCache.empty()) Link.push_back("-Wl,-plugin-opt,cache-dir=" + LtoCache); // LLVMgold, what ld, gold and mold load
+            }
+        } else {
+            Compile = {"-flto"};
+            Link = {"-flto=" + J};
+            if (LtoMode == "thin") std::cout << "Warning: GCC has no ThinLTO, B_EnableLTO(\"thin\") links the same as \"full\"" << std::endl;
+        }
+    }
+
+    size_t LinkSlotCount(){ // Links run at once, `--link-jobs` or half the pool, one with LTO (whose link is the heavy part)
+        return LinkJobs > 0 ? static_cast<size_t>(LinkJobs) : LtoMode.empty() ? static_cast<size_t>((std::max)(Jobs / 2, 1)) : 1;
+    }
+
+    std::string Linker(){ /* What UseLinker's choice comes to on this machine, found once
+                                    "auto" takes the first of mold, lld and gold that's installed, a linker that isn't
+                                    (or the compiler can't drive) falls back to the default with a warning
+                              */
+        if (LinkerChecked) return LinkerUsed;
+        LinkerChecked = true;
+        if (LinkerChoice.empty()) return LinkerUsed;
+        if (IsMSVC){
+            std::cout << "Warning: B_UseLinker is ignored with MSVC, linking with link.exe" << std::endl;
+            return LinkerUsed;
+        }
+        std::vector<std::string> Wanted = {LinkerChoice};
+        if (LinkerChoice == "auto") Wanted = {"mold", "lld", "gold"};
+        for (auto &name : Wanted){
+            std::string Program = name == "mold" ? "mold" : (Apple ? "ld64." : "ld.") + name;
+            if (FindProgram(Program).empty() || (Apple && name != "lld")) continue; // Only lld speaks Mach-O
+            LinkerUsed = name;
+            break;
+        }
+        if (LinkerUsed.empty() && LinkerChoice != "auto"){
+            std::cout << "Warning: linker " << LinkerChoice << " not found, using the compiler's default" << std::endl;
+        }
+        return LinkerUsed;
+    }
+
+    void LinkerFlags(std::vector<std::string>& Link){
+        /* What `UseLinker` adds to every link (not archives): `-fuse-ld=<linker>`, and the linker's own thread count
+           so each link uses its share of the pool instead of every core, see LinkSlotCount
+                mold: `--thread-count=N`, lld: `--threads=N`, gold: `--threads --thread-count=N`, ld.bfd has no threads
+           GCC before 12 has no `-fuse-ld=mold`, it gets mold's `ld` through `-B <prefix>/libexec/mold` instead
+        */
+        LinkThreads = 1;
+        std::string Name = Linker();
+        if (Name.empty()) return;
+        if (Name == "mold" && !CompilerIsClang()){
+            std::vector<std::string> VersionArgs = {"-dumpversion"};
+            InsertCMD(VersionArgs);
+            if (atoi(RunCommand(VersionArgs).output.c_str()) < 12){
+                std::error_code ec;
+                std::filesystem::path Dir = std::filesystem::path(FindProgram("mold")).parent_path().parent_path() / "libexec" / "mold";
+                if (!std::filesystem::exists(Dir / "ld", ec)){
+                    std::cout << "Warning: this GCC can't use mold (needs GCC 12 or " << Dir.string() << "/ld), using the default linker" << std::endl;
+                    LinkerUsed = "";
+                    return;
+                }
+                Link.insert(Link.end(), {"-B", Dir.string()});
+            } else {
+                Link.push_back("-fuse-ld=mold");
+            }
+        } else {
+            Link.push_back("-fuse-ld=" + Name);
+        }
+        LinkThreads = (std::max)(Jobs / static_cast<int>(LinkSlotCount()), 1);
+        std::string N = std::to_string(LinkThreads);
+        if (Name == "mold") Link.push_back("-Wl,--thread-count=" + N);
+        else if (Name == "lld") Link.push_back("-Wl,--threads=" + N);
+        else if (Name == "gold") Link.push_back("-Wl,--threads,--thread-count=" + N);
+        else LinkThreads = 1;
+    }
+
+    void DebugFlags(std::vector<std::string>& Compile, std::vector<std::string>& Link, std::string& Dwp){
+        /* What `SetDebugInfo` adds to every compile and link, only for debug info the flags already ask for (`-g`)
+                split:      `-gsplit-dwarf`, so the linker only copies a skeleton, plus `-ggnu-pubnames` and `--gdb-index`
+                            when the linker can build an index from them (gold, lld, mold, see UseLinker)
+                compressed: `-gz`, zlib compressed debug sections in objects and what's linked
+           Dwp is set to the dwp that packages each link's .dwo files, empty for none. llvm-dwp is preferred, binutils' dwp
+           only reads DWARF 4 (so with it the compiles get `-gdwarf-4`), and neither reads compressed .dwo files, so with
+           packaging only the link compresses
+        */
+        Dwp = "";
+        SplitUsed = false;
+        if (!SplitDwarf && !CompressDebug) return;
+        if (IsMSVC || Apple){
+            std::cout << "Warning: B_SetDebugInfo is ignored " << (IsMSVC ? "with MSVC" : "on macOS") << std::endl;
+            return;
+        }
+        // Without -g there's no .dwo to split off (or package), and LTO compiles write none either
+        std::vector<std::string> Flags;
+        AppendOpts(Flags, compileopts);
+        if (!Profile.empty()) AppendOpts(Flags, Profiles[Profile].compile);
+        bool Debug = AsksForDebugInfo(Flags);
+        SplitUsed = SplitDwarf && Debug && LtoMode.empty();
+        if (SplitDwarf && Debug && !LtoMode.empty()) std::cout << "Note: split debug info is off with LTO, which writes no .dwo files" << std::endl;
+        if (SplitUsed){
+            Compile.push_back("-gsplit-dwarf");
+            std::string Name = Linker();
+            if (Name == "gold" || Name == "lld" || Name == "mold"){
+                Compile.push_back("-ggnu-pubnames");
+                Link.push_back("-Wl,--gdb-index");
+            } else {
+                std::cout << "Note: without B_UseLinker(\"gold\"), \"lld\" or \"mold\" split debug info links have no --gdb-index" << std::endl;
+            }
+        }
+        if (SplitUsed && PackageDwarf){
+            for (std::string Tool : {CompilerIsClang() ? CompilerTool("dwp", "llvm-dwp") : std::string("llvm-dwp"), std::string("llvm-dwp"), std::string("dwp")}){
+                if (FindProgram(Tool).empty()) continue;
+                Dwp = Tool;
+                break;
+            }
+            if (Dwp.empty()) std::cout << "Warning: dwp not found, the .dwo files are left next to the objects" << std::endl;
+            else if (Dwp.find("llvm-dwp") == std::string::npos) Compile.push_back("-gdwarf-4");
+        }
+        if (CompressDebug){
+            if (Dwp.empty()) Compile.push_back("-gz");
+            Link.push_back("-gz");
+        }
+    }
+
+    std::string CompilerTool(const std::string& GccTool, const std::string& LlvmTool){
+        /* A tool that comes with the compiler, named after it so "gcc-12" gets "gcc-ar-12" and "clang-15" "llvm-ar-15"
+        */
+        std::vector<std::string> Compiler = SplitBySpace(StripBadChars(IsCXX ? CXX : CC));
+        std::string Name = Compiler.empty() ? "" : std::filesystem::path(Compiler.back()).filename().string();
+        std::string Families[][2] = {{"g++", GccTool}, {"gcc", GccTool}, {"clang++", LlvmTool}, {"clang", LlvmTool}};
+        for (auto &family : Families){
+            size_t at = Name.find(family[0]);
+            if (at != std::string::npos) return Name.substr(0, at) + family[1] + Name.substr(at + family[0].size());
+        }
+        return CompilerIsClang() ? LlvmTool : GccTool; // Plain "cc" and the like
+    }
+
+    std::string Archiver(){ /* The `ar` to build static libraries with
+                                    With LTO the objects hold compiler IR, and only the compiler's own wrapper (gcc-ar, llvm-ar)
+                                    writes a symbol index for those
+                            */
+        if (LtoMode.empty() || Apple) return "ar"; // Apple's ar reads bitcode itself
+        std::string Wrapper = CompilerTool("gcc-ar", "llvm-ar");
+        if (CompilerIsClang() && Wrapper.find("llvm-ar") == std::string::npos) Wrapper = "llvm-ar";
+        if (FindProgram(Wrapper).empty()){
+            std::cout << "Warning: " << Wrapper << " not found, static libraries built with ar may lose their LTO symbols" << std::endl;
+            return "ar";
+        }
+        return Wrapper;
+    }
+
+    void PgoPrepare(){
+        /* Set up a `--pgo=` build, both phases build into Obuild/pgo/ with the same object names, so GCC finds each
+                object's .gcda where the instrumented object left it
+                instrument: drops the old profile data, then `-fprofile-generate` (GCC) or `-fprofile-instr-generate` (Clang,
+                            writing pgo/profraw/<pid>-<n>.profraw)
+                use:        merges Clang's .profraw files into pgo/default.profdata, warns about sources that changed since
+                            the profile was taken, then `-fprofile-use` / `-fprofile-instr-use`
+        */
+        if (IsMSVC){
+            std::cerr << "--pgo isn't supported with MSVC" << std::endl;
+            exit(1);
+        }
+        std::string Dir = std::filesystem::absolute(TreeDir).string();
+        if (!Dir.empty() && (Dir.back() == '/' || Dir.back() == '\\')) Dir.pop_back();
+        std::string Raw = Dir + "/profraw";
+        std::string Data = Dir + "/default.profdata";
+        std::error_code ec;
+        bool Clang = CompilerIsClang();
+        if (PgoPhase == "instrument"){
+            std::filesystem::remove_all(Raw, ec);
+            for (auto it = std::filesystem::recursive_directory_iterator(Dir, ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)){
+                if (it->path().extension() == ".gcda") std::filesystem::remove(it->path(), ec);
+            }
+            if (Clang) PgoCompileArgs = {"-fprofile-instr-generate=" + Raw + "/%p-%m.profraw"};
+            else PgoCompileArgs = {"-fprofile-generate", "-fprofile-update=prefer-atomic"};
+            PgoLinkArgs = PgoCompileArgs;
+            return;
+        }
+        bool HaveData = false;
+        if (Clang){
+            std::vector<std::string> Merge = {CompilerTool("llvm-profdata", "llvm-profdata"), "merge", "-o", Data};
+            for (auto it = std::filesystem::directory_iterator(Raw, ec); !ec && it != std::filesystem::directory_iterator(); it.increment(ec)){
+                if (it->path().extension() == ".profraw") Merge.push_back(it->path().string());
+            }
+            if (Merge.size() > 4){ // New training runs, fold them into the profile
+                CmdResult result = RunCommand(Merge);
+                std::cout << "PGO: merging " << Merge.size() - 4 << " raw profile(s)" << std::endl << result.output;
+                if (result.status != 0){
+                    std::cerr << "Failed to merge the profiles: " << ShowCommand(Merge) << std::endl;
+                    exit(1);
+                }
+                std::filesystem::remove_all(Raw, ec);
+            }
+            HaveData = std::filesystem::exists(Data, ec);
+            PgoCompileArgs = {"-fprofile-instr-use=" + Data, "-Wprofile-instr-unprofiled", "-Wprofile-instr-missing"};
+        } else {
+            for (auto it = std::filesystem::recursive_directory_iterator(Dir, ec); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)){
+                if (it->path().extension() == ".gcda") HaveData = true;
+            }
+            PgoCompileArgs = {"-fprofile-use", "-fprofile-correction", "-Wmissing-profile"};
+        }
+        if (!HaveData){
+            std::cerr << "No profile data in " << Dir << ", run ./build --pgo=instrument and train the instrumented build first" << std::endl;
+            exit(1);
+        }
+        PgoLinkArgs = PgoCompileArgs;
+
+        // The sources the profile was taken from, see PgoFinish
+        std::ifstream in(TreeDir + PgoStateName);
+        std::string line;
+        size_t Changed = 0, Total = 0;
+        while (std::getline(in, line)){
+            size_t space = line.find(' ');
+            if (space == std::string::npos) continue;
+            Total++;
+            if (FileHash(line.substr(space + 1)) != line.substr(0, space)) Changed++;
+        }
+        if (Total == 0){
+            std::cout << "Warning: no record of the sources this profile was taken from" << std::endl;
+        } else if (Changed > 0){
+            std::cout << "Warning: " << Changed << " of " << Total << " source file(s) changed since --pgo=instrument, "
+                      << "the profile is stale for them, rerun --pgo=instrument and the training to refresh it" << std::endl;
+        }
+    }
+
+    void CountUnprofiled(const std::string& output){ /* Count a `--pgo=use` compile's missing profile warnings, by file and by function
+                                                                GCC:   -Wmissing-profile, "'x.gcda' profile count data file not found" once
+                                                                       for a file, "profile for function 'f' not found" for each function
+                                                                Clang: -Wprofile-instr-unprofiled once for a file, -Wprofile-instr-missing
+                                                                       "of N functions, M have no data" for the rest
+                                                      */
+        std::istringstream lines(output);
+        std::string line;
+        while (std::getline(lines, line)){
+            if (line.find("[-Wmissing-profile]") != std::string::npos){
+                if (line.find("profile count data file not found") != std::string::npos) PgoUnprofiledFiles++;
+                else PgoUnprofiled++;
+            } else if (line.find("[-Wprofile-instr-unprofiled]") != std::string::npos){
+                PgoUnprofiledFiles++;
+            } else if (line.find("[-Wprofile-instr-missing]") != std::string::npos){
+                size_t at = line.find("incomplete: of ");
+                at = at == std::string::npos ? at : line.find(", ", at);
+                if (at != std::string::npos) PgoUnprofiled += strtoull(line.c_str() + at + 2, nullptr, 10);
+            }
+        }
+    }
+
+    void PgoFinish(const std::vector<Job>& AllJobs){
+        /* After a successful `--pgo=` build
+                instrument: record the hash of every source and header the compiles read (in pgo/.obuild_pgo_state),
+                            then run the training command from BUILD.cpp's directory
+                use:        report the files and functions the compiler found no profile for
+        */
+        if (PgoPhase == "use"){
+            std::cout << "PGO: of the files compiled this build, " << PgoUnprofiledFiles << " had no profile data and "
+                      << PgoUnprofiled << " function(s) in the others had none" << std::endl;
+            return;
+        }
+        std::set<std::string> Sources;
+        for (auto &job : AllJobs){
+            if (job.kind != CompileJob) continue;
+            std::vector<std::string> inputs;
+            JobInputs(job, inputs);
+            for (auto &in : inputs){
+                if (!EndsWith(in, ".gch") && !EndsWith(in, ".pch")) Sources.insert(in);
+            }
+        }
+        std::ofstream out(TreeDir + PgoStateName, std::ios::trunc);
+        for (auto &src : Sources) out << FileHash(src) << " " << src << "\n";
+        out.close();
+        if (PgoTraining.empty()){
+            std::cout << "PGO: run your workload with the programs in Obuild/" << TreeDir << "out, then ./build --pgo=use" << std::endl;
+            return;
+        }
+        std::vector<std::string> Training = PgoTraining;
+        for (auto &arg : Training){ // "{out}" is where this build's programs are, e.g. Obuild/Release/pgo/out
+            for (size_t at = arg.find("{out}"); at != std::string::npos; at = arg.find("{out}", at)) arg.replace(at, 5, "Obuild/" + TreeDir + "out");
+        }
+        std::cout << "PGO TRAINING: " << ShowCommand(Training) << std::endl;
+        std::error_code ec;
+        std::filesystem::path Build = std::filesystem::current_path(ec); // Obuild, back to it whatever the training did
+        std::filesystem::current_path(Build.parent_path(), ec);
+        if (ec){
+            std::cerr << "Failed to switch to " << Build.parent_path().string() << ": " << ec.message() << std::endl;
+            exit(1);
+        }
+        CmdResult result = RunCommand(Training);
+        std::filesystem::current_path(Build, ec);
+        if (ec){
+            std::cerr << "Failed to switch back to " << Build.string() << ": " << ec.message() << std::endl;
+            exit(1);
+        }
+        std::cout << result.output;
+        if (result.status != 0){
+            std::cerr << "Training failed (exit " << result.status << ")" << std::endl;
+            exit(1);
+        }
+        std::cout << "PGO: training done, now run ./build --pgo=use" << std::endl;
+    }
+
+
+    bool FindLibrary(const std::string& name, std::string& Output, std::string& LinkFile){
+        /* Where library target `name` ends up, false if there's no such library
+                Output is the file its link writes, LinkFile what a target linking against it hands the linker
+                (the same file, except for the import library of a Windows .dll)
+        */
+        for (auto &lib : libsotb){
+            if (lib.name != name) continue;
+            if (Apple) Output = "out/lib" + name + ".dylib";
+            else if (Windows && !IsMSVC) Output = name + ".dll";
+            else if (Windows) Output = "out/" + name + ".dll";
+            else Output = "out/lib" + name + ".so";
+            LinkFile = Output;
+            if (Windows && !IsMSVC) LinkFile = "lib" + name + ".dll.a";
+            else if (Windows) LinkFile = name + ".lib";
+            Output = TreeDir + Output;
+            LinkFile = TreeDir + LinkFile;
+            return true;
+        }
+        for (auto &lib : libatb){
+            if (lib.name != name) continue;
+            if (!IsMSVC) Output = "out/lib" + name + ".a";
+            else Output = "out/" + name + ".lib";
+            Output = TreeDir + Output;
+            LinkFile = Output;
+            return true;
+        }
+        return false;
+    }
+
+    void LinkOrder(const std::string& name, std::vector<std::string>& Order, std::unordered_map<std::string, int>& State){
+        // Depth first walk of what `name` links against, State is 1 while on the current path and 2 once done
+        // Walked backwards, so reversing Order keeps the order libraries were given in
+        State[name] = 1;
+        auto &deps = TargetDeps[name];
+        for (auto dep = deps.rbegin(); dep != deps.rend(); ++dep){
+            if (State[*dep] == 1){
+                std::cerr << "Targets " << name << " and " << *dep << " link against each other" << std::endl;
+                exit(1);
+            }
+            if (State[*dep] == 0) LinkOrder(*dep, Order, State);
+        }
+        State[name] = 2;
+        Order.push_back(name);
+    }
+
+    void AddTargetLinks(const std::string& name, std::vector<std::string>& LinkArgs, std::vector<std::string>& Inputs){
+        /* Add the libraries target `name` links against (directly or through another library) to its link
+                Dependents come before their dependencies, so static libraries resolve in one pass
+                Inputs gets each library's output, which makes the link wait for the library's own link
+        */
+        std::vector<std::string> Order;
+        std::unordered_map<std::string, int> State;
+        LinkOrder(name, Order, State);
+        Order.pop_back(); // `name` itself, finished last
+        bool Shared = false;
+        for (auto dep = Order.rbegin(); dep != Order.rend(); ++dep){
+            std::string Output, LinkFile;
+            if (!FindLibrary(*dep, Output, LinkFile)){
+                std::cerr << "Target " << name << " links against " << *dep << ", which is not a library target" << std::endl;
+                exit(1);
+            }
+            LinkArgs.push_back(LinkFile);
+            Inputs.push_back(Output);
+            if (Output != LinkFile || !EndsWith(Output, IsMSVC ? ".lib" : ".a")) Shared = true;
+        }
+        if (Shared && Linux) LinkArgs.push_back("-Wl,-rpath,$ORIGIN"); // Dynamic libraries sit next to what uses them in out/
+        if (Shared && Apple) LinkArgs.push_back("-Wl,-rpath,@loader_path");
+    }
+
+    std::string FileHash(const std::string& path){ // Hash of a file's contents as hex, empty if it can't be read
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return "";
+        std::stringstream text;
+        text << in.rdbuf();
+        std::ostringstream hex;
+        hex << std::hex << HashString(text.str());
+        return hex.str();
+    }
+
+    void RebuildDriver(char *argv[], const char* BuildFile){
+        /* Recompile this build program and run it again when BUILD.cpp or ObjBuild.hpp changed since it was built
+                Cheap when nothing changed: two file times compared with the program's own
+                A newer file whose contents hash to what <dir>/.obuild_driver recorded (just touched) doesn't count
+        */
+        #ifndef _WIN32
+        if (!BuildFile || getenv("OBJBUILD_REEXEC")) return; // Already rebuilt once this run
+        std::error_code ec;
+        std::filesystem::path Self = argv[0];
+        if (Self.parent_path().empty()) return; // Found through PATH, not ours to replace
+        auto SelfTime = std::filesystem::last_write_time(Self, ec);
+        if (ec) return;
+        std::string Sources[] = {BuildFile, __FILE__};
+        bool Newer = false;
+        for (auto &src : Sources){
+            auto SrcTime = std::filesystem::last_write_time(src, ec);
+            if (!ec && SrcTime > SelfTime) Newer = true;
+        }
+        if (!Newer) return;
+
+        std::string Stamp = (Self.parent_path() / ".obuild_driver").string();
+        std::string Hashes = FileHash(Sources[0]) + " " + FileHash(Sources[1]);
+        std::ifstream in(Stamp);
+        std::string Recorded;
+        std::getline(in, Recorded);
+        in.close();
+        if (Recorded == Hashes){ // Same contents, bring the program's time forward so we don't hash again
+            std::filesystem::last_write_time(Self, std::filesystem::file_time_type::clock::now(), ec);
+            return;
+        }
+
+        const char* cxxEnv = getenv("CXX");
+        if (!cxxEnv){
+            std::cerr << BuildFile << " changed, but CXX isn't set to rebuild " << Self.string() << " with" << std::endl;
+            return;
+        }
+        std::cout << "REBUILD: " << Self.string() << " (" << BuildFile << " or ObjBuild.hpp changed)" << std::endl;
+        std::string Tmp = Self.string() + ".new";
+        std::vector<std::string> DriverArgs = SplitBySpace(cxxEnv);
+        DriverArgs.insert(DriverArgs.end(), {"-std=c++17", "-pthread", "-o", Tmp, BuildFile});
+        CmdResult result = RunCommand(DriverArgs);
+        std::cout << result.output;
+        if (result.status != 0){
+            std::cerr << "Failed to rebuild " << Self.string() << ": " << ShowCommand(DriverArgs) << std::endl;
+            exit(1);
+        }
+        std::filesystem::rename(Tmp, Self, ec); // Replacing a running program is fine, the old one stays open until we exec
+        std::ofstream(Stamp, std::ios::trunc) << Hashes << std::endl;
+        setenv("OBJBUILD_REEXEC", "1", 1);
+        execv(Self.c_str(), argv);
+        std::cerr << "Failed to run the rebuilt " << Self.string() << std::endl;
+        exit(1);
+        #else
+        (void)argv; (void)BuildFile; // A running .exe can't be replaced, rerun MkBuild.bat instead
+        #endif
+    }
+
+    std::string FlagsTag(const std::vector<std::string>& CompArgs){ // Short hex tag of a compile command's flags, used in object names
+        std::ostringstream tag;
+        tag << std::hex << std::setw(8) << std::setfill('0') << (CommandHash(CompArgs) & 0xffffffffULL);
+        return tag.str();
+    }
 
-// Start of actual code
+    std::vector<std::string> UnityFiles(const Target& CurrentTarget){
+        /* Merge a target's sources into unity/<target>_<n>.c(pp), each one just `#include`s its sources
+                Existing unity files are read back first and keep their members, new sources fill batches with room
+                (or new batches) in sorted order, so editing one source only recompiles its own batch
+                Returns the sources to compile, unity files first, then the excluded sources
+        */
+        UnityConfig Config = GlobalUnity;
+        auto Own = TargetUnity.find(CurrentTarget.name);
+        if (Own != TargetUnity.end()) Config = Own->second;
+        if (Config.files == 0 && Config.bytes == 0) return CurrentTarget.files;
 
-class ObjBuild {
-typedef struct Target { // Target type, does NOT contain compilation info
-    std::string name;
-    std::vector<std::string> files;
-} Target;
+        std::string Ext = IsCXX ? ".cpp" : ".c";
+        std::string Prefix = CurrentTarget.name + "_";
+        const std::string IncStart = "#include \"../../";
+        auto &Excluded = UnityExcludes[CurrentTarget.name];
+        std::vector<std::string> Result;
+        std::unordered_set<std::string> Wanted;
+        for (auto &file : CurrentTarget.files){
+            if (Excluded.count(file)) continue;
+            Wanted.insert(file);
+        }
+        std::error_code ec;
+        auto Bytes = [&](const std::string& file){
+            std::uintmax_t size = std::filesystem::file_size("../" + file, ec);
+            return ec ? 0 : size;
+        };
+        auto Fits = [&](const std::vector<std::string>& batch, std::uintmax_t size, const std::string& file){
+            if (batch.empty()) return true;
+            if (Config.files && batch.size() >= Config.files) return false;
+            if (Config.bytes && size + Bytes(file) > Config.bytes) return false;
+            return true;
+        };
 
-private:
-    bool HasHead = false;
-    bool IsDone = false;
-    bool IsCXX = false;
-    bool IsC = false;
+        // Read back the batches of the last build
+        std::filesystem::create_directories("unity");
+        std::map<size_t, std::vector<std::string>> Batches;
+        std::unordered_set<std::string> Placed;
+        std::vector<std::string> Overflow;
+        for (auto &entry : std::filesystem::directory_iterator("unity", ec)){
+            std::string name = entry.path().filename().string();
+            if (name.rfind(Prefix, 0) != 0 || entry.path().extension() != Ext) continue;
+            std::string index = entry.path().stem().string().substr(Prefix.size());
+            if (index.empty() || index.find_first_not_of("0123456789") != std::string::npos) continue;
+            auto &batch = Batches[std::stoul(index)];
+            std::uintmax_t size = 0;
+            std::ifstream in(entry.path());
+            std::string line;
+            while (std::getline(in, line)){
+                if (line.rfind(IncStart, 0) != 0 || line.size() < IncStart.size() + 1) continue;
+                std::string file = line.substr(IncStart.size(), line.size() - IncStart.size() - 1);
+                if (!Wanted.count(file) || Placed.count(file)) continue; // Removed, excluded or listed twice
+                if (!Fits(batch, size, file)){ // Limits got smaller, move it
+                    Overflow.push_back(file);
+                } else {
+                    batch.push_back(file);
+                    size += Bytes(file);
+                }
+                Placed.insert(file);
+            }
+        }
 
-    std::vector<std::string> SplitBySpace(const std::string& input) { 
-                                                    // Split a std::string into a std::vector<std::string>
-        std::vector<std::string> result;
-        std::istringstream iss(input);
-        std::string token;
-        while (iss >> token) {
-            result.push_back(token);
+        // Fill in the sources not in a batch yet
+        std::vector<std::string> New = Overflow;
+        for (auto &file : CurrentTarget.files){
+            if (Wanted.count(file) && !Placed.count(file)){
+                New.push_back(file);
+                Placed.insert(file);
+            }
+        }
+        std::sort(New.begin(), New.end());
+        for (auto &file : New){
+            bool Added = false;
+            for (auto &batch : Batches){
+                std::uintmax_t size = 0;
+                for (auto &member : batch.second) size += Bytes(member);
+                if (!batch.second.empty() && Fits(batch.second, size, file)){
+                    batch.second.push_back(file);
+                    Added = true;
+                    break;
+                }
+            }
+            if (!Added){
+                size_t next = Batches.empty() ? 0 : Batches.rbegin()->first + 1;
+                for (auto &batch : Batches){ // Reuse an emptied batch before making a new one
+                    if (batch.second.empty()){
+                        next = batch.first;
+                        break;
+                    }
+                }
+                Batches[next].push_back(file);
+            }
         }
-        return result;
-    }
 
-    bool EndsWith(const std::string& str, const std::string& suffix) {
-        return str.size() >= suffix.size() &&
-            str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+        // Write batches that changed, drop empty ones
+        for (auto &batch : Batches){
+            std::string name = "unity/" + Prefix + std::to_string(batch.first) + Ext;
+            if (batch.second.empty()){
+                std::filesystem::remove(name, ec);
+                continue;
+            }
+            std::string text = "// Generated by ObjBuild, unity file for " + CurrentTarget.name + "\n";
+            for (auto &file : batch.second) text += IncStart + file + "\"\n";
+            std::ifstream in(name, std::ios::binary);
+            std::stringstream old;
+            if (in) old << in.rdbuf();
+            in.close();
+            if (old.str() != text){ // Untouched files keep their time, so their objects stay up to date
+                std::ofstream(name, std::ios::binary | std::ios::trunc) << text;
+            }
+            Result.push_back("Obuild/" + name);
+        }
+        for (auto &file : CurrentTarget.files){
+            if (Excluded.count(file)) Result.push_back(file);
+        }
+        return Result;
     }
-    std::string Join(const std::vector<std::string>& vec, const std::string& delim) { 
-                                                    // Join an std::vector<std::string> into a single std::string
-        std::string result;
-        for (size_t i = 0; i < vec.size(); ++i) {
-            result += vec[i];
-            if (i != vec.size() - 1) {
-                result += delim;
+
+    bool WildMatch(const std::string& pat, size_t p, const std::string& str, size_t s){ // One path segment, `*` and `?`
+        for (; p < pat.size(); p++, s++){
+            if (pat[p] == '*'){
+                for (size_t rest = s; rest <= str.size(); rest++){
+                    if (WildMatch(pat, p + 1, str, rest)) return true;
+                }
+                return false;
             }
+            if (s == str.size() || (pat[p] != '?' && pat[p] != str[s])) return false;
         }
-        return result;
+        return s == str.size();
     }
-    void SetPlatform(){ // Set platform based on compiler macros
-        #ifdef __APPLE__ 
-        Apple = true;
-        #endif 
-        #ifdef _WIN32
-        Windows = true;
-        #endif
-        #ifdef __gnu_linux__
-        Linux = true;
-        #endif
-        #ifdef __linux__ 
-        Linux = true;
-        #endif
+
+    bool SegmentsMatch(const std::vector<std::string>& pat, size_t p, const std::vector<std::string>& path, size_t s){
+        // `**` stands for any number of directories, including none
+        if (p == pat.size()) return s == path.size();
+        if (pat[p] == "**"){
+            for (size_t rest = s; rest <= path.size(); rest++){
+                if (SegmentsMatch(pat, p + 1, path, rest)) return true;
+            }
+            return false;
+        }
+        return s < path.size() && WildMatch(pat[p], 0, path[s], 0) && SegmentsMatch(pat, p + 1, path, s + 1);
     }
 
-    void CheckBeforeAdd(){ // Check that build system is initialized, and building has not ran
-        if (!HasHead){
-            std::cerr << "Did not initialize system yet" << std::endl;
-            exit(1);
-        } else if (IsDone){
-            std::cerr << "Tried to add Target and/or Option after Configure Finished" << std::endl;
-            exit(1);
+    std::vector<std::string> SplitSegments(const std::string& path){ // "src/a/b.c" -> "src" "a" "b.c", empty parts dropped
+        std::vector<std::string> segs;
+        std::string cur;
+        for (char ch : path){
+            if (ch == '/' || ch == '\\'){
+                if (!cur.empty() && cur != ".") segs.push_back(cur);
+                cur.clear();
+            } else {
+                cur += ch;
+            }
         }
+        if (!cur.empty() && cur != ".") segs.push_back(cur);
+        return segs;
     }
 
+    bool GlobMatch(const std::string& pattern, const std::string& path){ // Whole path against a pattern like "src/**/*.c"
+        return SegmentsMatch(SplitSegments(pattern), 0, SplitSegments(path), 0);
+    }
 
-    std::string StripBadChars(const std::string& input) {
-        std::string clean; // temp var
-        for (char ch : input) { // Loop through var and remove non-printable chars (\0 \n \t \r etc.)
-            if (isprint(static_cast<unsigned char>(ch))) clean += ch;
+    const DirListing& ListDir(const std::string& dir){
+        /* What's in a directory (relative to BUILD.cpp), from the directory index when its time didn't change
+                Hidden entries and, in BUILD.cpp's own directory, Obuild are left out
+        */
+        static const DirListing Missing;
+        std::string fsdir = dir.empty() ? ".." : "../" + dir;
+        DirsSeen.insert(dir);
+        int64_t mtime;
+        if (!FileTime(fsdir, mtime)) return Missing;
+        auto cached = DirIndex.find(dir);
+        if (cached != DirIndex.end() && cached->second.mtime == mtime) return cached->second;
+        DirListing &listing = DirIndex[dir];
+        listing = DirListing();
+        listing.mtime = mtime;
+        std::error_code ec;
+        for (auto it = std::filesystem::directory_iterator(fsdir, ec); !ec && it != std::filesystem::directory_iterator(); it.increment(ec)){
+            std::string name = it->path().filename().string();
+            if (name.empty() || name[0] == '.') continue;
+            if (dir.empty() && name == "Obuild") continue;
+            if (it->is_directory(ec)) listing.dirs.push_back(name);
+            else if (it->is_regular_file(ec)) listing.files.push_back(name);
         }
+        std::sort(listing.files.begin(), listing.files.end());
+        std::sort(listing.dirs.begin(), listing.dirs.end());
+        DirsListed++;
+        DirIndexChanged = true;
+        return listing;
+    }
 
-        return clean;
+    void WalkGlob(const SourceGlob& glob, const std::string& dir, size_t depth, size_t maxdepth, std::vector<std::string>& found){
+        // Collect files under `dir` matching the glob, `depth` is how many segments deep `dir` is
+        for (auto &exclude : glob.exclude){ // "src/legacy/**" leaves src/legacy out entirely
+            if (EndsWith(exclude, "/**") && GlobMatch(exclude.substr(0, exclude.size() - 3), dir)) return;
+        }
+        const DirListing &listing = ListDir(dir);
+        std::string prefix = dir.empty() ? "" : dir + "/";
+        for (auto &name : listing.files){
+            std::string path = prefix + name;
+            if (!GlobMatch(glob.pattern, path)) continue;
+            bool excluded = false;
+            for (auto &exclude : glob.exclude) excluded = excluded || GlobMatch(exclude, path);
+            if (!excluded) found.push_back(path);
+        }
+        if (depth + 1 >= maxdepth) return;
+        for (auto &name : listing.dirs) WalkGlob(glob, prefix + name, depth + 1, maxdepth, found);
     }
 
-    void InsertCMD(std::string &CurrCmd){
-        if (IsCXX){                            // Check if project has been set as C++
-            CurrCmd.insert(0, CXX);
-        } else if (IsC) {                      // Check if project has been set as C
-            CurrCmd.insert(0, CC);
-        } else {
-            std::cerr << "Project type not set" << std::endl; // Error if project type hasnt been set
-            exit(1);
+    void ExpandGlobs(){ /* Add the sources every AddSources pattern matches to its target
+                                The walk starts at the pattern's leading directories without wildcards, and goes only as deep
+                                as the pattern can reach unless it has a `**`
+                                Matches are sorted, so the file list (and unity batches) don't depend on directory order
+                        */
+        if (SourceGlobs.empty()) return;
+        LoadDirIndex();
+        DirsSeen.clear();
+        for (auto &glob : SourceGlobs){
+            Target* target = nullptr;
+            for (auto list : {&exectb, &libsotb, &libatb}){
+                for (auto &tb : *list){
+                    if (tb.name == glob.target) target = &tb;
+                }
+            }
+            if (!target){
+                std::cerr << "AddSources: there's no target named " << glob.target << std::endl;
+                exit(1);
+            }
+            std::vector<std::string> segs = SplitSegments(glob.pattern);
+            std::string base;
+            size_t depth = 0;
+            while (depth + 1 < segs.size() && segs[depth].find_first_of("*?") == std::string::npos){
+                base += (base.empty() ? "" : "/") + segs[depth];
+                depth++;
+            }
+            bool deep = std::find(segs.begin(), segs.end(), "**") != segs.end();
+            std::vector<std::string> found;
+            WalkGlob(glob, base, depth, deep ? SIZE_MAX : segs.size(), found);
+            std::sort(found.begin(), found.end());
+            if (found.empty()) std::cout << "Warning: " << glob.pattern << " matched no sources for " << glob.target << std::endl;
+            std::unordered_set<std::string> have(target->files.begin(), target->files.end());
+            for (auto &file : found){
+                if (have.insert(file).second) target->files.push_back(file);
+            }
         }
+        for (auto dir = DirIndex.begin(); dir != DirIndex.end();){ // Forget directories no glob reaches anymore
+            if (DirsSeen.count(dir->first)){
+                ++dir;
+            } else {
+                dir = DirIndex.erase(dir);
+                DirIndexChanged = true;
+            }
+        }
+        if (DirIndexChanged) SaveDirIndex();
     }
 
-    void CompileAll(Target CurrentTarget, std::string CompCmd, std::vector<std::string> &Objs){
-        for (int cidx = 0; cidx < CurrentTarget.files.size(); cidx++){ // Main Compile Loop
+    void CompileAll(Target CurrentTarget, std::vector<std::string> CompArgs, std::vector<std::string> &Objs, std::vector<Job> &CompileJobs,
+                    std::unordered_set<std::string> &QueuedObjs){
+        CurrentTarget.files = UnityFiles(CurrentTarget);
+        InsertCMD(CompArgs);
+        std::vector<std::string> PreArgsBase = CompArgs; // What preprocessing for the compiler cache starts from
+        std::string PchOut;
+        auto Pch = PchHeaders.find(CurrentTarget.name);
+        if (Pch != PchHeaders.end()){ // Every TU of the target uses its precompiled header, and is rebuilt with it
+            std::vector<std::string> UseArgs, PreUseArgs;
+            PrecompileHeader(CurrentTarget.name, Pch->second, CompArgs, UseArgs, PreUseArgs, PchOut, Objs, CompileJobs, QueuedObjs);
+            CompArgs.insert(CompArgs.end(), UseArgs.begin(), UseArgs.end());
+            PreArgsBase.insert(PreArgsBase.end(), PreUseArgs.begin(), PreUseArgs.end());
+        }
+        // Objects are named after their source and flags, so targets compiling a source the same way share one object
+        //      and e.g. the `-fPIC` copy for a dynamic library gets its own
+        std::string Tag = FlagsTag(CompArgs);
+        CompArgs.insert(CompArgs.end(), PgoCompileArgs.begin(), PgoCompileArgs.end()); // Not in the tag, both PGO phases share objects
+        bool Cacheable = !CacheDir.empty() && !IsMSVC && PgoPhase != "use" && !SplitUsed; // The cache key doesn't cover profile data,
+                                                                                             // and holds no .dwo
+        // Workers get the preprocessed source, where PGO and split DWARF would leave files they write or read behind,
+        //      the precompiled header would be compiled in as source, and some debug info comes out different (see RemoteSafe)
+        bool Remote = !Workers.empty() && !IsMSVC && PgoPhase.empty() && !SplitUsed && PchOut.empty() && RemoteSafe(CompArgs);
+        for (size_t cidx = 0; cidx < CurrentTarget.files.size(); cidx++){ // Main Compile Loop
             // Vars for compiling
-            auto CCompCmd = CompCmd;
+            auto CCompArgs = CompArgs;
             auto Filename = CurrentTarget.files.at(cidx);
-            int ExtPos;
-            InsertCMD(CCompCmd);
 
-            // Make compile output name
-            std::filesystem::path oname = Filename;
-            if (!IsMSVC){
-                oname.replace_extension(".o");
-            } else {
-                oname.replace_extension(".obj");
+            // Make compile output name, src/File1.c -> src/File1.<tag>.o
+            // Plain string work, std::filesystem::path costs more than the rest of a no-op build's queueing
+            size_t slash = Filename.find_last_of(Windows ? "/\\" : "/");
+            size_t dot = Filename.rfind('.');
+            if (dot == std::string::npos || (slash != std::string::npos && dot < slash) || dot == slash + 1) dot = Filename.size();
+            std::string oname = TreeDir + Filename.substr(0, dot) + "." + Tag + (IsMSVC ? ".obj" : ".o");
+            Objs.push_back(oname);
+            if (!QueuedObjs.insert(oname).second){ // Another target already compiles this exact object
+                continue;
             }
 
             if (Windows){
@@ -165,24 +3018,437 @@ private:
             } else {
                 Filename.insert(0, "../");
             }
-            if (!oname.parent_path().empty()){ // Create parent directories
-                std::filesystem::create_directories(oname.parent_path());
+            size_t odir = oname.find_last_of(Windows ? "/\\" : "/");
+            if (odir != std::string::npos && MadeDirs.insert(oname.substr(0, odir)).second){ // Create parent directories
+                std::filesystem::create_directories(oname.substr(0, odir));
             }
 
-            // Add filename, output name, and append output name to Objs to link
+            // Add filename, output name
+            // Also ask the compiler for the headers it read, `-MMD -MF` writes them to <obj>.d, `/showIncludes` prints them
             if (!IsMSVC){
-                CCompCmd.append(" -c " + Filename + " -o " + oname.c_str() + " ");
+                CCompArgs.insert(CCompArgs.end(), {"-MMD", "-MF", oname + ".d", "-c", Filename, "-o", oname});
             } else if (IsMSVC && IsCXX){
-                CCompCmd.append(" /EHsc /c " + Filename + " /Fo:" + oname.c_str() + " ");
+                CCompArgs.insert(CCompArgs.end(), {"/showIncludes", "/EHsc", "/c", Filename, "/Fo:" + oname});
             } else {
-                CCompCmd.append(" /c " + Filename + " /Fo:" + oname.c_str() + " ");
+                CCompArgs.insert(CCompArgs.end(), {"/showIncludes", "/c", Filename, "/Fo:" + oname});
             }
-            Objs.push_back(oname);
-            // Execute cleaned compile command
-            std::cout << "COMPILE: " << Filename << std::endl;
-            system(StripBadChars(CCompCmd).c_str());
+            // With the compiler cache or workers on, the same flags with `-E` give the preprocessed source the cache is keyed on
+            //      and workers compile
+            std::vector<std::string> PreArgs;
+            if (Cacheable || Remote){
+                PreArgs = PreArgsBase;
+                PreArgs.insert(PreArgs.end(), {"-MMD", "-MF", oname + ".d", "-E", Filename, "-o", oname + ".i"});
+                if (Remote) PreArgs.push_back(CompilerIsClang() ? "-frewrite-includes" : "-fdirectives-only"); // See RemoteArgs
+            }
+            // Queue compile command, it runs together with every other target's compiles
+            std::vector<std::string> Inputs = {Filename};
+            if (!PchOut.empty()) Inputs.push_back(PchOut);
+            if (PgoPhase == "use"){ // New training data recompiles
+                std::error_code ec;
+                std::string Profile = oname.substr(0, oname.size() - 2) + ".gcda";
+                if (CompilerIsClang()) Profile = TreeDir + "default.profdata";
+                if (std::filesystem::exists(Profile, ec)) Inputs.push_back(Profile);
+            }
+            CompileJobs.push_back({"COMPILE: " + Filename, std::move(CCompArgs), oname, std::move(Inputs), true, std::move(PreArgs), CompileJob, Remote});
+        }
+    }
+    std::vector<Job> QueueJobs(){ /* Expand source patterns and turn every target into its compile and link jobs
+                                            Compiles come first, then links, see RunJobs for how they are ordered
+                                    */
+        ExpandGlobs();
+        std::vector<std::string> ExtraCompile, ExtraLink; // Profile, LTO, linker and debug info flags, after BUILD.cpp's own
+        LtoFlags(ExtraCompile, ExtraLink);
+        LinkerFlags(ExtraLink);
+        std::string Dwp; // Packages each executable's and shared library's .dwo files
+        DebugFlags(ExtraCompile, ExtraLink, Dwp);
+        if (!Profile.empty()){
+            auto &flags = Profiles[Profile];
+            ExtraCompile.insert(ExtraCompile.begin(), flags.compile.begin(), flags.compile.end());
+            ExtraLink.insert(ExtraLink.begin(), flags.link.begin(), flags.link.end());
+        }
+        std::vector<Job> CompileJobs; // Every target's compiles and precompiled headers
+        std::vector<Job> LinkJobs; // Every target's links, each one waits only for its own objects and libraries
+        std::unordered_set<std::string> QueuedObjs; // Objects already queued, each is compiled once for every target using it
+        for (size_t idx = 0; idx < exectb.size(); idx++){ // Loop for executable building
+
+            // Vars for executable building
+            auto CurrentTarget = exectb.at(idx);
+            std::vector<std::string> CompArgs;
+            std::vector<std::string> LinkArgs;
+            std::vector<std::string> Objs;
+        
+            // Add in `compileopts`
+            AppendOpts(CompArgs, compileopts);
+            CompArgs.insert(CompArgs.end(), ExtraCompile.begin(), ExtraCompile.end());
+
+            // Compile All
+            CompileAll(CurrentTarget, CompArgs, Objs, CompileJobs, QueuedObjs);
+
+            std::string OutName = TreeDir + "out/" + CurrentTarget.name;
+            if (Windows) OutName.append(".exe"); // If we're on windows, make it a .exe
+
+            // Insert Linker, add in Object filenames, libraries from TargetLinks and -o flags
+            std::vector<std::string> Inputs = Objs;
+            InsertCMD(LinkArgs);
+            LinkArgs.insert(LinkArgs.end(), Objs.begin(), Objs.end());
+            AddTargetLinks(CurrentTarget.name, LinkArgs, Inputs);
+            if (!IsMSVC) LinkArgs.insert(LinkArgs.end(), {"-o", OutName});
+            else LinkArgs.push_back("/Fe:" + OutName);
+            // Insert Linker Commands
+            if (IsMSVC) LinkArgs.push_back("/link");
+            LinkArgs.insert(LinkArgs.end(), ExtraLink.begin(), ExtraLink.end());
+            LinkArgs.insert(LinkArgs.end(), PgoLinkArgs.begin(), PgoLinkArgs.end());
+            AppendOpts(LinkArgs, linkopts);
+            // Queue final linking command, relinked only when an object or library is newer than the executable
+            LinkJobs.push_back({"LINK EXECUTABLE: " + CurrentTarget.name, LinkArgs, OutName, Inputs, false, {}, LinkJob});
+            if (!Dwp.empty()){ // Runs in parallel with the other links, nothing waits on it
+                LinkJobs.push_back({"PACKAGE DEBUG INFO: " + CurrentTarget.name, {Dwp, "-e", OutName, "-o", OutName + ".dwp"},
+                                    OutName + ".dwp", {OutName}, false, {}, PackageJob});
+            }
+        }
+        for (size_t idx = 0; idx < libsotb.size(); idx++){
+
+            // Vars for library building
+            auto CurrentTarget = libsotb.at(idx);
+            std::vector<std::string> CompArgs;
+            std::vector<std::string> LinkArgs;
+            std::string OutName; // Library file the link produces
+            std::string ImpName; // What linking against it takes, see FindLibrary
+            std::vector<std::string> Objs;
+            FindLibrary(CurrentTarget.name, OutName, ImpName);
+        
+            // Add in `compileopts`
+            AppendOpts(CompArgs, compileopts);
+            CompArgs.insert(CompArgs.end(), ExtraCompile.begin(), ExtraCompile.end());
+
+            if (Apple){ /*  For macOS, Compilation of a Dynamic Library needs `-fPIC`
+                            For macOS, Linking of a Dynamic Library need 
+                                `-dynamiclib` and is Prefix with `lib` and File Extension is `.dylib`
+                        */
+                LinkArgs.insert(LinkArgs.end(), {"-dynamiclib", "-o", OutName, "-Wl,-install_name,@rpath/lib" + CurrentTarget.name + ".dylib"});
+                CompArgs.push_back("-fPIC");
+            }
+            if (Linux){ /* For Linux, Compilation of a Shared Object needs `-fPIC`
+                           For Linux, Linking of a Dynamic Library need 
+                                `-shared` and is Prefix with `lib` and File Extension is `.so`
+                        */
+                LinkArgs.insert(LinkArgs.end(), {"-shared", "-o", OutName, "-Wl,-soname,lib" + CurrentTarget.name + ".so"});
+                CompArgs.push_back("-fPIC");
+            }
+            if (Windows){ /* For Windows, Linking of a Dynamic Link Library needs `-shared` on things like Cygwin & MinGW
+                                    Output is file extension is `.dll`
+                                    Microsoft's Dynamic Link Libraries consist of an 
+                                            Export Lib (.dll) and Import Lib (.a / .lib)
+                                    To get an import library, we use the linker flag `--out-implib` and we prefix the
+                                            Import Library with prefix `lib` and use the File Extension `.dll.a`, unless on MSVC then we use
+                                                    File Extension `.lib` and no prefix
+                          */
+                if (!IsMSVC){
+                    LinkArgs.insert(LinkArgs.end(), {"-shared", "-o", OutName, "-Wl,--out-implib," + ImpName});
+                } else {
+                    LinkArgs.insert(LinkArgs.end(), {"/LD", "/Fe:" + OutName});
+                }
+            }
+
+            // Compile All
+            CompileAll(CurrentTarget, CompArgs, Objs, CompileJobs, QueuedObjs);
+
+            // Append Object filenames and libraries from TargetLinks to link command
+            std::vector<std::string> Inputs = Objs;
+            LinkArgs.insert(LinkArgs.end(), Objs.begin(), Objs.end());
+            AddTargetLinks(CurrentTarget.name, LinkArgs, Inputs);
+            // Insert Linker
+            InsertCMD(LinkArgs);
+
+            // Insert Linker Commands
+            if (IsMSVC) LinkArgs.insert(LinkArgs.end(), {"/link", "/IMPLIB:" + ImpName});
+            LinkArgs.insert(LinkArgs.end(), ExtraLink.begin(), ExtraLink.end());
+            LinkArgs.insert(LinkArgs.end(), PgoLinkArgs.begin(), PgoLinkArgs.end());
+            AppendOpts(LinkArgs, linkopts);
+            // Queue final linking command
+            LinkJobs.push_back({"LINK DYNAMIC LIB: " + CurrentTarget.name, LinkArgs, OutName, Inputs, false, {}, LinkJob});
+            if (!Dwp.empty()){
+                LinkJobs.push_back({"PACKAGE DEBUG INFO: " + CurrentTarget.name, {Dwp, "-e", OutName, "-o", OutName + ".dwp"},
+                                    OutName + ".dwp", {OutName}, false, {}, PackageJob});
+            }
+        }
+        for (size_t idx = 0; idx < libatb.size(); idx++){
+
+            // Vars for library building, note that LinkArgs is set immediatly, this is because
+            //      building a static library uses `ar` not the linker, which `ar` is much simpler
+            auto CurrentTarget = libatb.at(idx);
+            std::vector<std::string> CompArgs;
+            std::vector<std::string> Objs;
+            std::vector<std::string> LinkArgs;
+            std::string OutName;
+            std::string ImpName;
+            FindLibrary(CurrentTarget.name, OutName, ImpName);
+            if (!IsMSVC) LinkArgs = {Archiver(), ArchiveMode == "thin" ? "rcsT" : "rcs", OutName}; // Thin ones list the objects' paths
+            else LinkArgs = {"lib", "/OUT:" + OutName};
+            if (IsMSVC && !LtoMode.empty()) LinkArgs.push_back("/LTCG");
+
+            // Add in compile options
+            AppendOpts(CompArgs, compileopts);
+            CompArgs.insert(CompArgs.end(), ExtraCompile.begin(), ExtraCompile.end());
+        
+            // Compile all
+            CompileAll(CurrentTarget, CompArgs, Objs, CompileJobs, QueuedObjs);
+
+            // Append Object filenames to link command
+            LinkArgs.insert(LinkArgs.end(), Objs.begin(), Objs.end());
+
+            // Queue link command
+            LinkJobs.push_back({"LINK STATIC LIB: " + CurrentTarget.name, LinkArgs, OutName, Objs, false, {}, ArchiveJob});
+        }
+        std::vector<Job> AllJobs = std::move(CompileJobs);
+        AllJobs.insert(AllJobs.end(), std::make_move_iterator(LinkJobs.begin()), std::make_move_iterator(LinkJobs.end()));
+        return AllJobs;
+    }
+
+    std::vector<Job> QueueMatrix(){ /* Queue every configuration of the build matrix into one job list for one RunJobs
+                                            Each one is queued with its toolchain and profile into its own tree, so no two share an
+                                            object and the pool keeps every core busy across all of them, not one configuration at a time
+                                    */
+        std::vector<Job> AllJobs;
+        for (auto &config : Matrix){
+            CC = Toolchains[config.toolchain].cc + " ";
+            CXX = Toolchains[config.toolchain].cxx + " ";
+            Profile = config.profile;
+            TreeDir = config.tree;
+            ClangState = -1; // Another compiler, see CompilerIsClang and Linker
+            LinkerChecked = false;
+            std::filesystem::create_directories(TreeDir + "out");
+            std::vector<Job> ConfigJobs = QueueJobs();
+            for (auto &job : ConfigJobs) job.banner = config.tree.substr(0, config.tree.size() - 1) + " " + job.banner;
+            config.first = AllJobs.size();
+            config.count = ConfigJobs.size();
+            AllJobs.insert(AllJobs.end(), std::make_move_iterator(ConfigJobs.begin()), std::make_move_iterator(ConfigJobs.end()));
+        }
+        return AllJobs;
+    }
+
+    void ReportMatrix(const std::vector<Job>& jobs){ /* After a matrix build, one column per configuration: whether it built,
+                                                           how many of its jobs ran, their CPU time, when its last job finished
+                                                           and the size of everything it links
+                                                   */
+        std::vector<std::string> Rows = {"status", "ran", "cpu time", "done at"};
+        std::vector<std::vector<std::string>> Cells(Rows.size()); // Row -> one cell per configuration
+        std::map<std::string, size_t> OutputRow; // Output without its tree -> row
+        for (size_t c = 0; c < Matrix.size(); c++){
+            auto &config = Matrix[c];
+            size_t ran = 0, failed = 0;
+            double cpu = 0, end = 0;
+            for (size_t i = config.first; i < config.first + config.count; i++){
+                if (JobFailed[i]) failed++;
+                if (!JobDirty[i]) continue;
+                ran++;
+                cpu += JobCpu[i];
+                end = (std::max)(end, JobEnd[i]);
+            }
+            char text[64];
+            Cells[0].push_back(failed ? "FAILED (" + std::to_string(failed) + ")" : "ok");
+            Cells[1].push_back(std::to_string(ran) + "/" + std::to_string(config.count));
+            snprintf(text, sizeof(text), "%.2fs", cpu);
+            Cells[2].push_back(text);
+            snprintf(text, sizeof(text), "%.2fs", end);
+            Cells[3].push_back(ran ? text : "-");
+            for (size_t i = config.first; i < config.first + config.count; i++){
+                if (jobs[i].kind == CompileJob) continue;
+                std::string name = jobs[i].output.substr(config.tree.size());
+                if (!OutputRow.count(name)){
+                    OutputRow[name] = Rows.size();
+                    Rows.push_back(name);
+                    Cells.emplace_back(Matrix.size(), "-");
+                }
+                std::error_code ec;
+                uintmax_t size = std::filesystem::file_size(jobs[i].output, ec);
+                if (ec || JobFailed[i]) continue;
+                if (size < 1024 * 1024) snprintf(text, sizeof(text), "%.1f KiB", static_cast<double>(size) / 1024);
+                else snprintf(text, sizeof(text), "%.1f MiB", static_cast<double>(size) / (1024 * 1024));
+                Cells[OutputRow[name]][c] = text;
+            }
+        }
+        size_t Label = 0;
+        for (auto &row : Rows) Label = (std::max)(Label, row.size());
+        std::vector<size_t> Width;
+        for (size_t c = 0; c < Matrix.size(); c++){
+            Width.push_back(Matrix[c].tree.size() - 1);
+            for (auto &row : Cells) Width[c] = (std::max)(Width[c], row[c].size());
+        }
+        std::cout << "Matrix results (in Obuild/<toolchain>/<profile>/):" << std::endl << std::left;
+        std::cout << "  " << std::setw(static_cast<int>(Label)) << "";
+        for (size_t c = 0; c < Matrix.size(); c++){
+            std::cout << "  " << std::setw(c + 1 < Matrix.size() ? static_cast<int>(Width[c]) : 0) << Matrix[c].tree.substr(0, Matrix[c].tree.size() - 1);
+        }
+        std::cout << std::endl;
+        for (size_t r = 0; r < Rows.size(); r++){
+            std::cout << "  " << std::setw(static_cast<int>(Label)) << Rows[r];
+            for (size_t c = 0; c < Matrix.size(); c++) std::cout << "  " << std::setw(c + 1 < Matrix.size() ? static_cast<int>(Width[c]) : 0) << Cells[r][c];
+            std::cout << std::endl;
+        }
+        std::cout << std::right;
+    }
+
+    bool FinishBuild(size_t NJobs, size_t Ran){ // Save the stores and report on a finished build, false if it failed
+        if (Ran > 0){ // Nothing ran, so neither store changed
+            SaveDeps();
+            SaveLog();
+        }
+        if (!TraceFile.empty()) WriteTrace();
+        if (!CacheDir.empty() && CacheHits + CacheMisses > 0) CacheFinish();
+        if (RemoteCompiles + RemoteFailovers > 0){
+            std::cout << "Workers: " << RemoteCompiles << " compile(s) done remotely, " << RemoteFailovers << " failed over to here" << std::endl;
+            RemoteCompiles = 0;
+            RemoteFailovers = 0;
+        }
+        bool ok = FailedJobs == 0;
+        if (!ok){
+            std::cerr << "Build failed, " << FailedJobs << " command(s) failed" << std::endl;
+        } else if (Ran == 0){
+            std::cout << "Everything is up to date" << std::endl;
+        }
+        if (ShowStats) PrintStats(NJobs, Ran);
+        return ok;
+    }
+
+    void WatchLoop(std::vector<Job>& AllJobs, const std::vector<std::vector<Target>>& Declared){
+        /* `--watch`, keep the jobs, dep store and file table in memory and rebuild whenever a file the build reads changes
+                inotify watches the directory of every source and header (editors often save by renaming, which a watch
+                on the file itself would lose) plus every directory a source pattern walked
+                Events are collected until nothing happened for WatchQuiet ms, so a burst of saves or a git checkout is one rebuild
+                Only the changed files are stat'ed again, the up to date checks do the rest
+        */
+        #ifdef __linux__
+        int fd = inotify_init1(IN_CLOEXEC);
+        if (fd < 0){
+            std::cerr << "--watch: inotify_init1 failed: " << strerror(errno) << std::endl;
+            exit(1);
+        }
+        const uint32_t Mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_ATTRIB | IN_DELETE_SELF;
+        std::unordered_map<int, std::string> WatchDirs; // Watch descriptor -> directory, spelled the way the file table does
+        std::unordered_set<std::string> Watched;
+        std::unordered_set<std::string> GlobDirs; // Directories (as watched) whose listing feeds a source pattern
+        auto watchDir = [&](const std::string& dir){
+            if (!Watched.insert(dir).second) return;
+            int wd = inotify_add_watch(fd, dir.c_str(), Mask);
+            if (wd >= 0) WatchDirs[wd] = dir;
+        };
+        auto watchAll = [&](){ // Called after every build, compiles may have reported new headers
+            std::unordered_set<std::string> Outputs;
+            for (auto &job : AllJobs) Outputs.insert(job.output);
+            for (auto &job : AllJobs){
+                std::vector<std::string> inputs;
+                JobInputs(job, inputs);
+                for (auto &in : inputs){
+                    if (Outputs.count(in)) continue; // Built by us, its job notices when its own inputs change
+                    std::string dir, name;
+                    SplitPath(in, dir, name);
+                    if (!dir.empty()) watchDir(dir); // Anything right in Obuild is ours
+                }
+            }
+            GlobDirs.clear();
+            for (auto &dir : DirIndex){
+                std::string path = dir.first.empty() ? ".." : "../" + dir.first;
+                GlobDirs.insert(path);
+                watchDir(path);
+            }
+            if (DriverFile) watchDir("..");
+        };
+        watchAll();
+        const int WatchQuiet = 100;
+        std::string DriverName = std::filesystem::path(DriverFile ? DriverFile : "").filename().string();
+        std::vector<char> buf(64 * 1024);
+        std::cout << "Watching " << WatchDirs.size() << " director(ies) for changes, Ctrl-C to stop" << std::endl;
+        for (;;){
+            std::unordered_set<std::string> Changed;
+            bool Requeue = false, Overflow = false, Driver = false;
+            int timeout = -1; // Block for the first event, then wait for the burst to settle
+            for (;;){
+                struct pollfd pfd = {fd, POLLIN, 0};
+                int rc = poll(&pfd, 1, timeout);
+                if (rc < 0 && errno == EINTR) continue;
+                if (rc <= 0) break;
+                ssize_t got = read(fd, buf.data(), buf.size());
+                if (got <= 0) continue;
+                for (ssize_t off = 0; off < got;){
+                    auto *ev = reinterpret_cast<struct inotify_event*>(buf.data() + off);
+                    off += sizeof(struct inotify_event) + ev->len;
+                    if (ev->mask & IN_Q_OVERFLOW){
+                        Overflow = true;
+                        continue;
+                    }
+                    auto dir = WatchDirs.find(ev->wd);
+                    if (dir == WatchDirs.end()) continue;
+                    if (ev->mask & (IN_DELETE_SELF | IN_IGNORED)){ // The directory itself is gone, watch it again if it comes back
+                        Watched.erase(dir->second);
+                        Changed.insert(dir->second);
+                        Requeue = Requeue || GlobDirs.count(dir->second);
+                        WatchDirs.erase(dir);
+                        continue;
+                    }
+                    std::string name = ev->len ? ev->name : "";
+                    Changed.insert(dir->second == "/" ? "/" + name : dir->second + "/" + name);
+                    if (ev->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO) && GlobDirs.count(dir->second)){
+                        Requeue = true; // A source pattern may match a different set of files now
+                        Changed.insert(dir->second);
+                    }
+                    if (dir->second == ".." && !DriverName.empty() && (name == DriverName || name == "ObjBuild.hpp")) Driver = true;
+                }
+                timeout = WatchQuiet;
+            }
+            if (Driver){ // BUILD.cpp changed, rebuild and re-exec the driver, which starts watching again
+                if (chdir("..") == 0){
+                    RebuildDriver(DriverArgv, DriverFile);
+                    if (chdir("Obuild") != 0) exit(1);
+                }
+            }
+
+            auto Start = std::chrono::steady_clock::now();
+            bool Relevant = Requeue || Overflow; // Otherwise only a file the build reads counts
+            {
+                std::lock_guard<std::mutex> lock(StatLock);
+                if (Overflow){ // Lost events, so anything may have changed
+                    for (auto &fs : StatTable) fs.state = 0;
+                } else {
+                    for (auto &path : Changed){
+                        auto found = StatIds.find(path);
+                        if (found == StatIds.end()) continue;
+                        StatTable[found->second].state = 0;
+                        Relevant = true;
+                    }
+                }
+            }
+            if (!Relevant) continue;
+            if (Requeue || Overflow){
+                exectb = Declared[0];
+                libsotb = Declared[1];
+                libatb = Declared[2];
+                AllJobs = Matrix.empty() ? QueueJobs() : QueueMatrix();
+                ScanFiles(AllJobs);
+            }
+            BuildStart = Start;
+            FailedJobs = 0;
+            Trace.clear();
+            CacheHits = 0;
+            CacheMisses = 0;
+            size_t Ran = RunJobs(AllJobs);
+            if (!Matrix.empty() && Ran > 0) ReportMatrix(AllJobs);
+            bool ok = FinishBuild(AllJobs.size(), Ran);
+            if (Ran > 0){
+                std::cout << (ok ? "Rebuilt in " : "Failed after ") << std::fixed << std::setprecision(2)
+                          << std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count() << "s" << std::endl;
+                std::cout.unsetf(std::ios::fixed);
+            }
+            watchAll();
+            std::cout << "Watching " << WatchDirs.size() << " director(ies) for changes, Ctrl-C to stop" << std::endl;
         }
+        #else
+        (void)AllJobs; (void)Declared;
+        std::cerr << "--watch needs inotify, which only Linux has" << std::endl;
+        exit(1);
+        #endif
     }
+
 public:
 
 std::vector<std::string> linkopts; // Linker options
@@ -200,6 +3466,15 @@ bool Windows = false; // Platform Windows
 bool Linux = false; // Platform Linux
 bool IsMSVC = false;
 
+int Jobs = 1; // Max number of commands run at once, set by `-jN` or OBJBUILD_JOBS
+int LinkJobs = 0; // Max number of links run at once, set by `--link-jobs=N` or OBJBUILD_LINK_JOBS, 0 picks one (see RunJobs)
+uintmax_t MemBudget = 0; // Bytes the commands running at once may take together, 0 for no limit
+                         // Set by SetMemoryBudget, `--mem=` or OBJBUILD_MEM, otherwise what AvailableMemory finds
+std::string TreeDir; // Where objects and outputs go inside Obuild, "" or e.g. "Release/", "Release/pgo/"
+std::string Profile; // Build profile from `--profile=`, empty for none
+std::string TraceFile; // Where `--trace=<file>` writes the build's timings, empty for no trace
+std::string CacheDir; // Compiler cache directory, empty means no cache, set by SetCacheDir or OBJBUILD_CACHE_DIR
+uintmax_t CacheSize = 5ULL * 1024 * 1024 * 1024; // Compiler cache size limit in bytes, set by SetCacheSize or OBJBUILD_CACHE_SIZE
 
  void CreateBuild() { // Init ObjBuild
         // Check if on MSVC
@@ -212,6 +3487,12 @@ bool IsMSVC = false;
 		const char* ldEnv = getenv("LDFLAGS");
         const char* cflags = getenv("CFLAGS");
         const char* cppflags = getenv("CPPFLAGS");
+        const char* jobsEnv = getenv("OBJBUILD_JOBS");
+        const char* cacheEnv = getenv("OBJBUILD_CACHE_DIR");
+        const char* cacheSizeEnv = getenv("OBJBUILD_CACHE_SIZE");
+        const char* workersEnv = getenv("OBJBUILD_WORKERS");
+        const char* memEnv = getenv("OBJBUILD_MEM");
+        const char* linkJobsEnv = getenv("OBJBUILD_LINK_JOBS");
         std::string cEnv; 
 
         // Append CFLAGS and CPPFLAGS to temp var cEnv
@@ -253,23 +3534,93 @@ bool IsMSVC = false;
             compileopts.insert(compileopts.end(), cextra.begin(), cextra.end());
         }
 
+        // Default to one job per hardware thread, unless OBJBUILD_JOBS says otherwise
+        Jobs = static_cast<int>(std::thread::hardware_concurrency());
+        if (jobsEnv && atoi(jobsEnv) > 0) Jobs = atoi(jobsEnv);
+        if (Jobs < 1) Jobs = 1;
+        if (linkJobsEnv && atoi(linkJobsEnv) > 0) LinkJobs = atoi(linkJobsEnv);
+
+        // Memory budget for the job pool
+        MemBudget = memEnv ? ParseSize(memEnv) : AvailableMemory();
+
+        // Compiler cache, set up here so BUILD.cpp can still override it
+        if (cacheEnv && *cacheEnv) CacheDir = std::filesystem::absolute(cacheEnv).string();
+        if (cacheSizeEnv) CacheSize = ParseSize(cacheSizeEnv);
+
+        // Distributed compiles, BUILD.cpp can add more with AddWorker
+        if (workersEnv) AddWorkers(workersEnv);
+
+        // Built in profiles, BUILD.cpp can replace them with AddProfile
+        if (!IsMSVC){
+            Profiles["Debug"] = {{"-O0", "-g"}, {"-g"}};
+            Profiles["Release"] = {{"-O2", "-DNDEBUG"}, {}};
+            Profiles["RelWithDebInfo"] = {{"-O2", "-g", "-DNDEBUG"}, {"-g"}};
+        } else {
+            Profiles["Debug"] = {{"/Od", "/Zi"}, {"/DEBUG"}};
+            Profiles["Release"] = {{"/O2", "/DNDEBUG"}, {}};
+            Profiles["RelWithDebInfo"] = {{"/O2", "/Zi", "/DNDEBUG"}, {"/DEBUG"}};
+        }
+
         // Set platform bool's
         SetPlatform();
         // Set that this function ran succesfully
         HasHead = true;
 }
 
-ObjBuild(int argc, char *argv[]) { // Initializer
-    if (argc <= 2) {
-        if (strcmp(argv[1], "--clean") == 0){
+ObjBuild(int argc, char *argv[], const char* BuildFile = nullptr) { // Initializer, BuildFile is BUILD.cpp's path from B_MakeBuild
+    for (int aidx = 1; aidx < argc; aidx++){ // `--serve=address [-jN] [--compiler=gcc ...]` is a compile worker, not a build,
+        if (strncmp(argv[aidx], "--serve=", 8) != 0) continue; // see ServeCompiles
+        int slots = static_cast<int>(std::thread::hardware_concurrency());
+        std::vector<std::string> compilers;
+        for (int jidx = 1; jidx < argc; jidx++){
+            if (strncmp(argv[jidx], "-j", 2) == 0) slots = atoi(argv[jidx][2] ? argv[jidx] + 2 : jidx + 1 < argc ? argv[jidx + 1] : "0");
+            if (strncmp(argv[jidx], "--compiler=", 11) == 0) compilers.push_back(argv[jidx] + 11);
+        }
+        ServeCompiles(argv[aidx] + 8, (std::max)(slots, 1), compilers);
+    }
+    RebuildDriver(argv, BuildFile);
+    #ifndef _WIN32
+    unsetenv("OBJBUILD_REEXEC"); // Only guards the re-exec itself, --watch may rebuild again later
+    #endif
+    DriverArgv = argv;
+    DriverFile = BuildFile;
+    int CmdJobs = 0; // -jN from the command line, wins over OBJBUILD_JOBS
+    int CmdLinkJobs = 0;
+    for (int aidx = 1; aidx < argc; aidx++){
+        std::string Arg = argv[aidx];
+        if (Arg == "--clean"){
             std::cout << "Cleaning" << std::endl;
-            std::filesystem::remove_all("OBuild");
+            std::filesystem::remove_all("Obuild");
             exit(0);
+        } else if (Arg == "--stats"){
+            ShowStats = true;
+        } else if (Arg == "--watch"){
+            Watch = true;
+        } else if (Arg == "--pgo=instrument" || Arg == "--pgo=use"){ // Profile guided optimization, see PgoPrepare
+            PgoPhase = Arg.substr(6);
+        } else if (Arg.rfind("--profile=", 0) == 0){ // `--profile=Release`
+            Profile = Arg.substr(10);
+        } else if (Arg.rfind("--trace=", 0) == 0){ // `--trace=trace.json`
+            TraceFile = std::filesystem::absolute(Arg.substr(8)).string();
+        } else if (Arg.rfind("--mem=", 0) == 0){ // `--mem=8G`, `--mem=0` for no limit
+            CmdMem = Arg.substr(6);
+        } else if (Arg.rfind("--link-jobs=", 0) == 0){ // `--link-jobs=2`
+            CmdLinkJobs = atoi(Arg.c_str() + 12);
+        } else if (Arg == "-j" && aidx + 1 < argc){ // `-j N`
+            CmdJobs = atoi(argv[++aidx]);
+        } else if (Arg.rfind("-j", 0) == 0 && Arg.size() > 2){ // `-jN`
+            CmdJobs = atoi(Arg.c_str() + 2);
+        } else {
+            std::cerr << "Unknown option " << Arg << std::endl;
+            exit(1);
         }
     }
     std::cout << "Initializing ObjBuild" << std::endl;
 
     this->CreateBuild();
+    if (CmdJobs > 0) Jobs = CmdJobs;
+    if (CmdLinkJobs > 0) LinkJobs = CmdLinkJobs;
+    if (!CmdMem.empty()) MemBudget = ParseSize(CmdMem);
 
     std::cout << "Detected C Compiler " << CC << std::endl;
     std::cout << "Detected C++ Compiler " << CXX << std::endl;
@@ -283,6 +3634,10 @@ ObjBuild(int argc, char *argv[]) { // Initializer
          std::cout << "Detected OS Linux" << std::endl;
     }
 
+    if (!Profile.empty()) std::cout << "Using profile " << Profile << std::endl;
+    std::cout << "Using " << Jobs << " parallel job(s)";
+    if (MemBudget > 0) std::cout << " within " << MemBudget / (1024 * 1024) << " MiB of memory";
+    std::cout << std::endl;
     std::cout << "Your configuration will now be processed" << std::endl;
 }
 
@@ -348,6 +3703,146 @@ void AddCompileOpt(std::string compileopt){ // Adds compile options
     CheckBeforeAdd();
     compileopts.push_back(compileopt);
 }
+void SetCacheDir(std::string dir){ // Turns on the compiler cache, kept in `dir` (relative to BUILD.cpp's directory)
+    CheckBeforeAdd();
+    CacheDir = dir.empty() ? "" : std::filesystem::absolute(dir).string();
+}
+void SetCacheSize(std::string size){ // Sets the compiler cache size limit, e.g. "500M" or "5G"
+    CheckBeforeAdd();
+    CacheSize = ParseSize(size);
+}
+void AddPrecompiledHeader(std::string name, std::string header){ // Precompiles `header` for target `name` and includes it
+                                                                  // in every file of that target
+    CheckBeforeAdd();
+    PchHeaders[name] = header;
+}
+void SetUnityBuild(size_t files, size_t bytes = 0){ // Merges every target's sources into unity files of at most
+                                                    // `files` sources and/or `bytes` bytes each, 0 means no limit
+    CheckBeforeAdd();
+    GlobalUnity = {files, bytes};
+}
+void SetUnityBuild(std::string name, size_t files, size_t bytes = 0){ // Same, only for target `name`
+    CheckBeforeAdd();
+    TargetUnity[name] = {files, bytes};
+}
+void UnityExclude(std::string name, std::vector<std::string> files){ // Sources of target `name` that are never merged
+    CheckBeforeAdd();
+    UnityExcludes[name].insert(files.begin(), files.end());
+}
+void AddSources(std::string name, std::string pattern, std::vector<std::string> exclude = {}){
+    // Adds the sources matching `pattern` (like "src/**/*.c") to target `name`, minus those matching `exclude`
+    // Matched when the build runs, so the target may be added before or after this
+    CheckBeforeAdd();
+    SourceGlobs.push_back({name, pattern, exclude});
+}
+void TargetLinks(std::string name, std::vector<std::string> libs){ // Links target `name` against library targets `libs`
+                                                                   // from this build, which are built first
+    CheckBeforeAdd();
+    auto &deps = TargetDeps[name];
+    deps.insert(deps.end(), libs.begin(), libs.end());
+}
+void EnableLTO(std::string mode, std::string cache = ""){ // Link time optimization for every target, "full", "thin" or "off"
+                                                          // `cache` keeps ThinLTO's work between links (Clang, needs lld off macOS)
+    CheckBeforeAdd();
+    if (mode == "off"){
+        LtoMode = "";
+    } else if (mode == "full" || mode == "thin"){
+        LtoMode = mode;
+    } else {
+        std::cerr << "Unknown LTO mode " << mode << ", use \"full\", \"thin\" or \"off\"" << std::endl;
+        exit(1);
+    }
+    LtoCache = cache.empty() ? "" : std::filesystem::absolute(cache).string();
+}
+void AddProfile(std::string name, std::vector<std::string> compile, std::vector<std::string> link = {}){
+    // Adds (or replaces) build profile `name`, chosen with `./build --profile=name`, which builds in Obuild/<name>/
+    // `compile` is added to every compile and `link` (compiler driver flags, like "-fsanitize=address") to every link
+    CheckBeforeAdd();
+    Profiles[name] = {compile, link};
+}
+void SetMemoryBudget(std::string size){ // Memory the commands running at once may take together, e.g. "16G", "0" for no limit
+    CheckBeforeAdd();                     // `--mem=` still wins
+    if (CmdMem.empty()) MemBudget = ParseSize(size);
+}
+void UseLinker(std::string name){ // Links executables and shared libraries with "mold", "lld", "gold" or "bfd",
+                                   // "auto" for the fastest one installed, "default" for the compiler's own choice
+    CheckBeforeAdd();
+    if (name != "auto" && name != "default" && name != "mold" && name != "lld" && name != "gold" && name != "bfd"){
+        std::cerr << "Unknown linker " << name << ", use \"auto\", \"mold\", \"lld\", \"gold\", \"bfd\" or \"default\"" << std::endl;
+        exit(1);
+    }
+    LinkerChoice = name == "default" ? "" : name;
+    LinkerChecked = false;
+}
+void SetDebugInfo(std::string mode, bool package = false){ // "split" (-gsplit-dwarf), "compressed" (-gz), "split+compressed" or "default",
+                                                           // `package` runs dwp after each link to gather the .dwo files into <output>.dwp
+    CheckBeforeAdd();
+    if (mode != "split" && mode != "compressed" && mode != "split+compressed" && mode != "default"){
+        std::cerr << "Unknown debug info mode " << mode << ", use \"split\", \"compressed\", \"split+compressed\" or \"default\"" << std::endl;
+        exit(1);
+    }
+    SplitDwarf = mode == "split" || mode == "split+compressed";
+    CompressDebug = mode == "compressed" || mode == "split+compressed";
+    PackageDwarf = SplitDwarf && package;
+}
+void AddWorker(std::string address, int slots = 1){ // Sends up to `slots` compiles at once to the worker at `address`,
+                                                   // "unix:/path/to.sock" or "host:port", one started with `./build --serve=address`
+    CheckBeforeAdd();
+    CompileWorker worker;
+    worker.address = WorkerAddress(address);
+    worker.slots = (std::max)(slots, 1);
+    Workers.push_back(worker);
+}
+void AddToolchain(std::string name, std::string cc, std::string cxx){ // Names a C and C++ compiler for BuildMatrix,
+                                                                      // e.g. ("clang", "clang", "clang++")
+    CheckBeforeAdd();
+    if (name.empty() || name.find_first_of("/\\.") != std::string::npos){
+        std::cerr << "Bad toolchain name \"" << name << "\", it names a directory in Obuild" << std::endl;
+        exit(1);
+    }
+    Toolchains[name] = {cc, cxx};
+}
+void BuildMatrix(std::vector<std::string> toolchains, std::vector<std::string> profiles){
+    // Builds every toolchain from AddToolchain with every profile (AddProfile's or a built in one, "" for none) in one run,
+    // each into Obuild/<toolchain>/<profile>/ (Obuild/<toolchain>/ for ""), all of their jobs sharing one job pool, and prints the results side by side
+    CheckBeforeAdd();
+    if (profiles.empty()) profiles = {""};
+    Matrix.clear();
+    for (auto &toolchain : toolchains){
+        if (!Toolchains.count(toolchain)){
+            std::cerr << "BuildMatrix: there's no toolchain named " << toolchain << ", add it with B_AddToolchain first" << std::endl;
+            exit(1);
+        }
+        for (auto &profile : profiles){
+            MatrixConfig config;
+            config.toolchain = toolchain;
+            config.profile = profile;
+            config.tree = toolchain + "/" + (profile.empty() ? "" : profile + "/");
+            bool seen = false;
+            for (auto &other : Matrix) seen = seen || other.tree == config.tree;
+            if (!seen) Matrix.push_back(config);
+        }
+    }
+}
+void SetArchiveMode(std::string mode){ // How static libraries are written: "full" (every object copied in, each time), "thin"
+                                       // (`ar T`, paths to the objects in Obuild) or "incremental" (only changed objects replaced)
+    CheckBeforeAdd();
+    if (mode != "full" && mode != "thin" && mode != "incremental"){
+        std::cerr << "Unknown archive mode " << mode << ", use \"full\", \"thin\" or \"incremental\"" << std::endl;
+        exit(1);
+    }
+    if (mode == "thin" && Apple){
+        std::cout << "Warning: macOS ar has no thin archives, using incremental ones" << std::endl;
+        mode = "incremental";
+    }
+    if (IsMSVC && mode != "full") std::cout << "Warning: B_SetArchiveMode is ignored with MSVC" << std::endl;
+    ArchiveMode = mode;
+}
+void SetPgoTraining(std::vector<std::string> command){ // Command `--pgo=instrument` runs from BUILD.cpp's directory after building,
+                                                      // e.g. {"{out}/MyExec", "--benchmark"}, "{out}" is the instrumented out/
+    CheckBeforeAdd();
+    PgoTraining = command;
+}
 void AddLinkOpt(std::string linkopt){ // Adds Link Options
     CheckBeforeAdd();
     if (!IsMSVC){
@@ -359,6 +3854,35 @@ void AddLinkOpt(std::string linkopt){ // Adds Link Options
 
 void DoBuild() { // Finishes Build
     IsDone = true; // Set that everything is done
+    BuildStart = std::chrono::steady_clock::now();
+    if (!Matrix.empty() && !PgoPhase.empty()){
+        std::cerr << "--pgo can't build a matrix, use --profile= to pick one of its profiles" << std::endl;
+        exit(1);
+    }
+    if (!Matrix.empty() && !Profile.empty()){ // `--profile=` narrows the matrix down to that profile
+        Matrix.erase(std::remove_if(Matrix.begin(), Matrix.end(), [&](const MatrixConfig& config){ return config.profile != Profile; }), Matrix.end());
+        if (Matrix.empty()){
+            std::cerr << "No configuration of the matrix uses profile " << Profile << std::endl;
+            exit(1);
+        }
+    }
+    std::vector<std::string> Wanted = {Profile}; // Every profile this build uses
+    for (auto &config : Matrix) Wanted.push_back(config.profile);
+    for (auto &name : Wanted){
+        if (name.empty() || (Profiles.count(name) && name.find_first_of("/\\.") == std::string::npos)) continue;
+        std::cerr << "Unknown profile " << name << ", known are:";
+        for (auto &known : Profiles) std::cerr << " " << known.first;
+        std::cerr << std::endl;
+        exit(1);
+    }
+    // Each profile (and PGO) builds in its own tree, so switching between them never rebuilds, see QueueMatrix for a matrix's
+    TreeDir = (Profile.empty() ? "" : Profile + "/") + (PgoPhase.empty() ? "" : "pgo/");
+    if (!Matrix.empty()){
+        std::cout << "Building a matrix of " << Matrix.size() << " configuration(s):";
+        for (auto &config : Matrix) std::cout << " " << config.tree.substr(0, config.tree.size() - 1);
+        std::cout << std::endl;
+    }
+    for (auto &remote : Workers) std::cout << "Using worker " << remote.address << " with " << remote.slots << " slot(s)" << std::endl;
     std::string ObjPath;
     if (Windows) {
         ObjPath = "Obuild\\";
@@ -377,113 +3901,19 @@ void DoBuild() { // Finishes Build
         exit(1);
     }
     #endif
-    std::filesystem::create_directory("out");
-    for (int idx = 0; idx < exectb.size(); idx++){ // Loop for executable building
-
-        // Vars for executable building
-        auto CurrentTarget = exectb.at(idx);
-        std::string CompCmd;
-        std::string LinkCmd;
-        std::vector<std::string> Objs;
-        
-        // Add in `compileopts` to the right std::string
-        CompCmd.append(Join(compileopts, " "));
-
-        // Compile All
-        CompileAll(CurrentTarget, CompCmd, Objs);
-
-        // Append -o flags and add in Object filenames
-        LinkCmd.append(" " + Join(Objs, " ") + " ");
-        if (!IsMSVC) LinkCmd.append(" -o out/" + CurrentTarget.name + " ");
-        else LinkCmd.append(" /Fe:out/" + CurrentTarget.name);
-        InsertCMD(LinkCmd);
-        if (Windows) LinkCmd.append(".exe "); // If we're on windows, make it a .exe
-        // Insert Linker Commands
-        if (IsMSVC) LinkCmd.append(" /link ");
-        LinkCmd.append(Join(linkopts, " "));
-        // Execute cleaned final linking command
-        std::cout << "LINK EXECUTABLE: " << CurrentTarget.name << std::endl;
-        system(StripBadChars(LinkCmd).c_str());
-    }
-    for (int idx = 0; idx < libsotb.size(); idx++){
-
-        // Vars for library building
-        auto CurrentTarget = libsotb.at(idx);
-        std::string CompCmd;
-        std::string LinkCmd;
-        std::vector<std::string> Objs;
-        
-        // Add in and `compileopts` to the right std::string
-        CompCmd.append(Join(compileopts, " "));
-
-        if (Apple){ /*  For macOS, Compilation of a Dynamic Library needs `-fPIC`
-                        For macOS, Linking of a Dynamic Library need 
-                            `-dynamiclib` and is Prefix with `lib` and File Extension is `.dylib`
-                    */
-            LinkCmd.append(" -dynamiclib  -o out/lib" + CurrentTarget.name + ".dylib ");
-            CompCmd.append(" -fPIC ");
-        }
-        if (Linux){ /* For Linux, Compilation of a Shared Object needs `-fPIC`
-                       For Linux, Linking of a Dynamic Library need 
-                            `-shared` and is Prefix with `lib` and File Extension is `.so`
-                    */
-            LinkCmd.append(" -shared -o out/lib" + CurrentTarget.name + ".so ");
-            CompCmd.append(" -fPIC ");
-        }
-        if (Windows){ /* For Windows, Linking of a Dynamic Link Library needs `-shared` on things like Cygwin & MinGW
-                                Output is file extension is `.dll`
-                                Microsoft's Dynamic Link Libraries consist of an 
-                                        Export Lib (.dll) and Import Lib (.a / .lib)
-                                To get an import library, we use the linker flag `--out-implib` and we prefix the
-                                        Import Library with prefix `lib` and use the File Extension `.dll.a`, unless on MSVC then we use
-                                                File Extension `.lib` and no prefix
-                      */
-            if (!IsMSVC){
-                LinkCmd.append(" -shared -o " + CurrentTarget.name + ".dll -Wl,--out-implib,lib" + CurrentTarget.name + ".dll.a ");
-            } else {
-                LinkCmd.append(" /LD /Fe:out/" + CurrentTarget.name + ".dll ");
-            }
-        }
-
-        // Compile All
-        CompileAll(CurrentTarget, CompCmd, Objs);
-
-        // Append Object filenames to link command
-        LinkCmd.append(" " + Join(Objs, " ") + " ");
-        // Insert Linker
-        InsertCMD(LinkCmd);
-        // Execute cleaned final linking command
-
-        // Insert Linker Commands
-        if (IsMSVC) LinkCmd.append(" /link /IMPLIB:" + CurrentTarget.name + ".lib ");
-        LinkCmd.append(Join(linkopts, " "));
-        std::cout << "LINK DYNAMIC LIB: " << CurrentTarget.name << std::endl;
-        system(StripBadChars(LinkCmd).c_str());
-    }
-    for (int idx = 0; idx < libatb.size(); idx++){
-
-        // Vars for library building, note that LinkCmd is set immediatly, this is because
-        //      building a static library uses `ar` not the linker, which `ar` is much simpler
-        auto CurrentTarget = libatb.at(idx);
-        std::string CompCmd;
-        std::vector<std::string> Objs;
-        std::string LinkCmd;
-        if (!IsMSVC) LinkCmd = "ar rcs out/lib" + CurrentTarget.name + ".a ";
-        else LinkCmd = "lib /OUT:out/" + CurrentTarget.name + ".lib ";
-
-        // Add in compile options
-        CompCmd.append(Join(compileopts, " "));
-        
-        // Compile all
-        CompileAll(CurrentTarget, CompCmd, Objs);
-
-        // Append Object filenames to link command
-        LinkCmd.append(" " + Join(Objs, " ") + " ");
-
-        // Execute cleaned link command
-        std::cout << "LINK STATIC LIB: " << CurrentTarget.name << std::endl;
-        system(StripBadChars(LinkCmd).c_str());
-    }
+    if (Matrix.empty()) std::filesystem::create_directories(TreeDir + "out");
+    LoadDeps();
+    LoadLog();
+    if (!PgoPhase.empty()) PgoPrepare();
+    // Execute everything that is out of date as one task graph
+    std::vector<std::vector<Target>> Declared = {exectb, libsotb, libatb}; // Before source patterns add to them, for --watch
+    std::vector<Job> AllJobs = Matrix.empty() ? QueueJobs() : QueueMatrix();
+    ScanFiles(AllJobs);
+    size_t Ran = RunJobs(AllJobs);
+    if (!Matrix.empty() && Ran > 0) ReportMatrix(AllJobs);
+    if (!FinishBuild(AllJobs.size(), Ran) && !Watch) exit(1);
+    if (!PgoPhase.empty() && FailedJobs == 0) PgoFinish(AllJobs);
+    if (Watch) WatchLoop(AllJobs, Declared);
 }};
 
 #endif
@@ -0,0 +1,15 @@
+/* A compile worker for distributed builds, see "Distributed compiles" in the README
+        c++ -std=c++17 -O2 -o objworker ObjWorker.cpp -lpthread
+        ./objworker --serve=unix:/tmp/objbuild.sock -j8    or    ./objworker --serve=0.0.0.0:7070 -j16 --compiler=gcc --compiler=g++
+   Any build made from a BUILD.cpp does the same with `./build --serve=...`
+*/
+#include "ObjBuild.hpp"
+
+int main(int argc, char* argv[]) {
+    if (argc < 2 || strncmp(argv[1], "--serve=", 8) != 0){
+        std::cerr << "Usage: " << argv[0] << " --serve=unix:/path/to.sock|host:port [-jN] [--compiler=NAME ...]" << std::endl;
+        return 1;
+    }
+    ObjBuild Worker(argc, argv); // Serves until killed
+    return 0;
+}